@@ -0,0 +1,30 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+
+/// Best time in seconds of 'nb_runs' calls to 'f', after a first call to
+/// warm the caches up
+template <typename F> double measure(int nb_runs, F f) {
+  f();
+  double best = 1e30;
+  for (int i = 0; i < nb_runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/// Compare the scalar, SSE2 and AVX2 kernels of applyWindow
+void benchWindow();
+/// Compare the reads of Volume and BrickedVolume along the three planes and
+/// the trilinear samples of rays
+void benchLayout();
+/// Measure the ratio and the unpacking speed of brick_packing
+void benchPacking();
+
+#endif // BENCH_H
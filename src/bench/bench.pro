@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Micro-benchmarks of the kernels, to be built in release mode
+#
+#-------------------------------------------------
+
+TARGET = bench
+TEMPLATE = app
+
+CONFIG += console release
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+        window_bench.cpp \
+        layout_bench.cpp \
+        packing_bench.cpp \
+        ../thread_pool.cpp \
+        ../window_level.cpp \
+        ../brick_packing.cpp
+
+HEADERS += \
+        bench.h \
+        ../volume.h \
+        ../bricked_volume.h \
+        ../trilinear.h \
+        ../thread_pool.h \
+        ../window_level.h \
+        ../brick_packing.h
@@ -0,0 +1,130 @@
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bricked_volume.h"
+#include "trilinear.h"
+#include "volume.h"
+
+namespace {
+/// A ray through the volume, sampled once per voxel crossed
+struct Ray {
+  float origin[3];
+  float step[3];
+  int nb_steps;
+};
+
+/// Sum of the values of the axial planes, read row by row
+template <typename V> int64_t readAxial(const V &volume) {
+  int64_t sum = 0;
+  for (int z = 0; z < volume.depth; z++)
+    for (int y = 0; y < volume.height; y++)
+      for (int x = 0; x < volume.width; x++)
+        sum += volume.getValue(x, y, z);
+  return sum;
+}
+
+/// Sum of the values of the coronal planes, read row by row
+template <typename V> int64_t readCoronal(const V &volume) {
+  int64_t sum = 0;
+  for (int y = 0; y < volume.height; y++)
+    for (int z = 0; z < volume.depth; z++)
+      for (int x = 0; x < volume.width; x++)
+        sum += volume.getValue(x, y, z);
+  return sum;
+}
+
+/// Sum of the values of the sagittal planes, read row by row
+template <typename V> int64_t readSagittal(const V &volume) {
+  int64_t sum = 0;
+  for (int x = 0; x < volume.width; x++)
+    for (int z = 0; z < volume.depth; z++)
+      for (int y = 0; y < volume.height; y++)
+        sum += volume.getValue(x, y, z);
+  return sum;
+}
+
+/// Sum of the values sampled along 'rays' with the trilinear interpolation
+/// of SoftwareRenderer
+template <typename V>
+double readRays(const V &volume, const std::vector<Ray> &rays) {
+  double sum = 0;
+  for (const Ray &ray : rays) {
+    float p[3] = {ray.origin[0], ray.origin[1], ray.origin[2]};
+    for (int i = 0; i < ray.nb_steps; i++) {
+      sum += sampleTrilinear(volume, p);
+      for (int j = 0; j < 3; j++)
+        p[j] += ray.step[j];
+    }
+  }
+  return sum;
+}
+
+/// Rays between two random points of the volume, in random directions
+std::vector<Ray> getRandomRays(int width, int height, int depth, int count) {
+  std::mt19937 generator(1234);
+  std::uniform_real_distribution<float> unit(0, 1);
+  const float size[3] = {(float)width, (float)height, (float)depth};
+  std::vector<Ray> rays(count);
+  for (Ray &ray : rays) {
+    float end[3];
+    for (int j = 0; j < 3; j++) {
+      // Stay half a voxel away from the border of the volume
+      ray.origin[j] = 0.5f + unit(generator) * (size[j] - 1);
+      end[j] = 0.5f + unit(generator) * (size[j] - 1);
+    }
+    float length = std::sqrt((end[0] - ray.origin[0]) *
+                                 (end[0] - ray.origin[0]) +
+                             (end[1] - ray.origin[1]) *
+                                 (end[1] - ray.origin[1]) +
+                             (end[2] - ray.origin[2]) *
+                                 (end[2] - ray.origin[2]));
+    ray.nb_steps = std::max(1, (int)length);
+    for (int j = 0; j < 3; j++)
+      ray.step[j] = (end[j] - ray.origin[j]) / ray.nb_steps;
+  }
+  return rays;
+}
+
+template <typename V>
+void benchReads(const char *name, const V &volume,
+                 const std::vector<Ray> &rays) {
+  size_t nb_voxels = (size_t)volume.width * volume.height * volume.depth;
+  size_t nb_samples = 0;
+  for (const Ray &ray : rays)
+    nb_samples += ray.nb_steps;
+  // The sums are printed so that the reads are not optimized away
+  int64_t sum = 0;
+  double ray_sum = 0;
+  double axial = measure(3, [&]() { sum += readAxial(volume); });
+  double coronal = measure(3, [&]() { sum += readCoronal(volume); });
+  double sagittal = measure(3, [&]() { sum += readSagittal(volume); });
+  double random = measure(3, [&]() { ray_sum += readRays(volume, rays); });
+  std::printf("  %-7s axial %6.0f, coronal %6.0f, sagittal %6.0f Mvoxels/s, "
+              "trilinear rays %6.0f Msamples/s (%lld, %.0f)\n",
+              name, nb_voxels / axial * 1e-6, nb_voxels / coronal * 1e-6,
+              nb_voxels / sagittal * 1e-6, nb_samples / random * 1e-6,
+              (long long)sum, ray_sum);
+}
+} // namespace
+
+void benchLayout() {
+  // A CT sized volume, larger than the caches
+  Volume<int16_t> volume(512, 512, 192);
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> values(-1024, 1500);
+  for (size_t i = 0; i < volume.size(); i++)
+    volume.data()[i] = (int16_t)values(generator);
+  BrickedVolume<int16_t> bricked_volume(volume);
+  std::vector<Ray> rays =
+      getRandomRays(volume.width, volume.height, volume.depth, 20000);
+
+  std::printf("Reads of Volume and BrickedVolume of %dx%dx%d int16_t, single "
+              "thread:\n",
+              volume.width, volume.height, volume.depth);
+  benchReads("linear", volume, rays);
+  benchReads("bricked", bricked_volume, rays);
+}
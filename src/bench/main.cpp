@@ -0,0 +1,8 @@
+#include "bench.h"
+
+int main() {
+  benchWindow();
+  benchLayout();
+  benchPacking();
+  return 0;
+}
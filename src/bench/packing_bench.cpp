@@ -0,0 +1,93 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "brick_packing.h"
+
+namespace {
+/// Side of the bricks packed, as in PagedVolume
+const int brick_size = 32;
+const size_t brick_values = brick_size * brick_size * brick_size;
+
+/// The bricks of the middle 512x512x64 slab of a synthetic head CT: air,
+/// skull and soft tissue with Gaussian noise of 'noise' HU
+std::vector<std::vector<int16_t>> getHeadBricks(double noise) {
+  const int size = 512, depth = 64, first_layer = 96;
+  std::mt19937 generator(1234);
+  std::normal_distribution<double> gaussian(0, noise);
+  std::vector<std::vector<int16_t>> bricks;
+  const int nb_bricks = size / brick_size;
+  for (int bz = 0; bz < depth / brick_size; bz++) {
+    for (int by = 0; by < nb_bricks; by++) {
+      for (int bx = 0; bx < nb_bricks; bx++) {
+        std::vector<int16_t> brick(brick_values);
+        size_t i = 0;
+        for (int z = 0; z < brick_size; z++) {
+          for (int y = 0; y < brick_size; y++) {
+            for (int x = 0; x < brick_size; x++, i++) {
+              double dx = (bx * brick_size + x - 256) / 200.0;
+              double dy = (by * brick_size + y - 256) / 230.0;
+              double dz = (first_layer + bz * brick_size + z - 128) / 140.0;
+              double r = std::sqrt(dx * dx + dy * dy + dz * dz);
+              double value = -1000;
+              if (r <= 0.93)
+                value = 35 + 5 * std::sin(x * 0.05) + gaussian(generator);
+              else if (r <= 1)
+                value = 1200 + 4 * gaussian(generator);
+              else if (r <= 1.03)
+                value = -50 + gaussian(generator);
+              brick[i] = (int16_t)std::lround(value);
+            }
+          }
+        }
+        bricks.push_back(std::move(brick));
+      }
+    }
+  }
+  return bricks;
+}
+
+void benchBricks(const char *name,
+                 const std::vector<std::vector<int16_t>> &bricks) {
+  if (bricks.empty())
+    return;
+  std::vector<std::vector<uint8_t>> packed(bricks.size());
+  size_t packed_size = 0;
+  for (size_t i = 0; i < bricks.size(); i++) {
+    packValues(bricks[i].data(), brick_values, &packed[i]);
+    packed_size += packed[i].size();
+  }
+  size_t bytes = bricks.size() * brick_values * sizeof(int16_t);
+  std::vector<int16_t> values(brick_values);
+  double time = measure(5, [&]() {
+    for (const std::vector<uint8_t> &brick : packed)
+      unpackValues(brick.data(), brick_values, values.data());
+  });
+  std::printf("  %-24s %4zu bricks, %.2fx smaller, unpacked at %.2f GB/s\n",
+              name, bricks.size(), bytes / (double)packed_size,
+              bytes / time * 1e-9);
+}
+} // namespace
+
+void benchPacking() {
+  std::printf("unpackValues on 32^3 bricks, single thread:\n");
+  for (double noise : {4.0, 20.0}) {
+    std::vector<std::vector<int16_t>> bricks = getHeadBricks(noise);
+    // Bricks of air only are stored as a single value
+    std::vector<std::vector<int16_t>> tissue;
+    for (const std::vector<int16_t> &brick : bricks) {
+      if (std::any_of(brick.begin(), brick.end(),
+                      [](int16_t value) { return value != -1000; }))
+        tissue.push_back(brick);
+    }
+    std::string name = "head, noise " + std::to_string((int)noise) + " HU";
+    benchBricks(name.c_str(), bricks);
+    name = "tissue, noise " + std::to_string((int)noise) + " HU";
+    benchBricks(name.c_str(), tissue);
+  }
+}
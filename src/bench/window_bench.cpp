@@ -0,0 +1,36 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "window_level.h"
+
+void benchWindow() {
+  // A 512x512x64 block of values around a soft tissue window
+  const size_t count = 512 * 512 * 64;
+  std::vector<int16_t> src(count);
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> values(-1024, 1500);
+  for (int16_t &value : src)
+    value = (int16_t)values(generator);
+  std::vector<unsigned char> grey(count), classes(count);
+
+  std::printf("applyWindow on %zu values, single thread:\n", count);
+  const char *kernels[] = {"scalar", "SSE2", "AVX2"};
+  for (const char *kernel : kernels) {
+    if (!setWindowKernel(kernel)) {
+      std::printf("  %-7s not supported\n", kernel);
+      continue;
+    }
+    double grey_time = measure(10, [&]() {
+      applyWindow(src.data(), count, 40, 400, grey.data());
+    });
+    double classes_time = measure(10, [&]() {
+      applyWindow(src.data(), count, 40, 400, grey.data(), classes.data(), 4);
+    });
+    std::printf("  %-7s %7.0f Mvalues/s, with classes %7.0f Mvalues/s\n",
+                kernel, count / grey_time * 1e-6,
+                count / classes_time * 1e-6);
+  }
+}
@@ -0,0 +1,160 @@
+#include "brick_packing.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+/// First byte of the packed values
+enum PackingMode : uint8_t {
+  /// Followed by the single value, lowest byte first
+  CONSTANT = 0,
+  /// Followed by the number of bits of each line, then by the differences
+  LINES = 1
+};
+
+/// Bytes after the differences, so that 16 bytes can be read at any group
+const size_t padding = 8;
+
+/// Map small positive and negative differences to small unsigned values
+uint16_t toZigZag(uint16_t delta) {
+  return (uint16_t)((delta << 1) ^ (0 - (delta >> 15)));
+}
+
+uint16_t fromZigZag(uint16_t zigzag) {
+  return (uint16_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+}
+
+/// The line the values of 'line' are predicted from, nullptr for zeros
+const uint16_t *getReference(const uint16_t *values, size_t line) {
+  if (line % PACKED_LINE != 0)
+    return values + (line - 1) * PACKED_LINE;
+  if (line >= PACKED_LINE)
+    return values + (line - PACKED_LINE) * PACKED_LINE;
+  return nullptr;
+}
+
+/// The 8 bytes at 'bytes', the first one being the lowest
+uint64_t loadLittleEndian(const uint8_t *bytes) {
+  uint64_t word;
+  std::memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+/// Restore a line whose differences with 'reference' take BITS bits
+///
+/// Groups of 8 differences fill BITS bytes, they are read as two 64-bit
+/// words. Values do not depend on each other, the loop has no branch.
+template <int BITS>
+void unpackLine(const uint8_t *deltas, const uint16_t *reference,
+                uint16_t *dst) {
+  const uint64_t mask = (1u << BITS) - 1;
+  for (size_t group = 0; group < PACKED_LINE; group += 8, deltas += BITS) {
+    uint64_t low = loadLittleEndian(deltas);
+    uint64_t high = BITS > 8 ? loadLittleEndian(deltas + 8) : 0;
+    // Once unrolled, the differences are split with constant shifts
+#if defined(__GNUC__)
+#pragma GCC unroll 8
+#endif
+    for (int j = 0; j < 8; j++) {
+      const int bit = j * BITS;
+      uint64_t zigzag;
+      if (bit + BITS <= 64)
+        zigzag = low >> bit;
+      else if (bit >= 64)
+        zigzag = high >> ((bit - 64) & 63);
+      else
+        zigzag = (low >> bit) | (high << ((64 - bit) & 63));
+      dst[group + j] = (uint16_t)(reference[group + j] +
+                                  fromZigZag((uint16_t)(zigzag & mask)));
+    }
+  }
+}
+
+typedef void (*LineUnpacker)(const uint8_t *deltas, const uint16_t *reference,
+                             uint16_t *dst);
+
+/// The unpacker of each number of bits, lines of 0 bits are filled directly
+const LineUnpacker line_unpackers[17] = {
+    nullptr,        unpackLine<1>,  unpackLine<2>,  unpackLine<3>,
+    unpackLine<4>,  unpackLine<5>,  unpackLine<6>,  unpackLine<7>,
+    unpackLine<8>,  unpackLine<9>,  unpackLine<10>, unpackLine<11>,
+    unpackLine<12>, unpackLine<13>, unpackLine<14>, unpackLine<15>,
+    unpackLine<16>};
+} // namespace
+
+void packValues(const int16_t *values, size_t count,
+                std::vector<uint8_t> *packed) {
+  packed->clear();
+  if (std::all_of(values, values + count,
+                  [&](int16_t value) { return value == values[0]; })) {
+    uint16_t value = (uint16_t)values[0];
+    packed->push_back(CONSTANT);
+    packed->push_back((uint8_t)(value & 0xff));
+    packed->push_back((uint8_t)(value >> 8));
+    return;
+  }
+  // Differences are computed modulo 2^16, any value can be restored
+  const uint16_t *src = reinterpret_cast<const uint16_t *>(values);
+  size_t nb_lines = count / PACKED_LINE;
+  packed->assign(1 + nb_lines, 0);
+  (*packed)[0] = LINES;
+  const uint16_t zeros[PACKED_LINE] = {};
+  uint16_t deltas[PACKED_LINE];
+  for (size_t line = 0; line < nb_lines; line++) {
+    const uint16_t *reference = getReference(src, line);
+    if (reference == nullptr)
+      reference = zeros;
+    const uint16_t *line_values = src + line * PACKED_LINE;
+    uint16_t used = 0;
+    for (size_t i = 0; i < PACKED_LINE; i++) {
+      deltas[i] = toZigZag((uint16_t)(line_values[i] - reference[i]));
+      used |= deltas[i];
+    }
+    int bits = 0;
+    while (bits < 16 && (used >> bits) != 0)
+      bits++;
+    (*packed)[1 + line] = (uint8_t)bits;
+    // PACKED_LINE * bits is a whole number of bytes, starting from the
+    // lowest bit of the first one
+    uint64_t pending = 0;
+    int nb_pending = 0;
+    for (size_t i = 0; i < PACKED_LINE; i++) {
+      pending |= (uint64_t)deltas[i] << nb_pending;
+      nb_pending += bits;
+      for (; nb_pending >= 8; nb_pending -= 8) {
+        packed->push_back((uint8_t)pending);
+        pending >>= 8;
+      }
+    }
+  }
+  packed->insert(packed->end(), padding, 0);
+}
+
+void unpackValues(const uint8_t *packed, size_t count, int16_t *values) {
+  uint16_t *dst = reinterpret_cast<uint16_t *>(values);
+  if (packed[0] == CONSTANT) {
+    uint16_t value = (uint16_t)(packed[1] | packed[2] << 8);
+    std::fill(dst, dst + count, value);
+    return;
+  }
+  size_t nb_lines = count / PACKED_LINE;
+  const uint8_t *line_bits = packed + 1;
+  const uint8_t *deltas = line_bits + nb_lines;
+  const uint16_t zeros[PACKED_LINE] = {};
+  for (size_t line = 0; line < nb_lines; line++) {
+    const uint16_t *reference = getReference(dst, line);
+    if (reference == nullptr)
+      reference = zeros;
+    uint16_t *line_values = dst + line * PACKED_LINE;
+    int bits = line_bits[line];
+    if (bits == 0) {
+      std::copy(reference, reference + PACKED_LINE, line_values);
+      continue;
+    }
+    line_unpackers[bits](deltas, reference, line_values);
+    deltas += PACKED_LINE / 8 * bits;
+  }
+}
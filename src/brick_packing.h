@@ -0,0 +1,32 @@
+#ifndef BRICK_PACKING_H
+#define BRICK_PACKING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Lossless packing of 16-bit modality values, used to keep the bricks of a
+/// volume compressed in memory
+///
+/// Values are processed by lines of PACKED_LINE values, such as the lines of
+/// a brick. Each line is replaced by its difference with the line above it
+/// (the first line of each slice of PACKED_LINE lines with the first line of
+/// the previous slice), and the differences of a line are stored on the
+/// number of bits needed by the largest one. Lines of air or of a uniform
+/// tissue take a single byte, blocks made of a single value take 3 bytes.
+/// Lines are restored without any dependency between their values.
+///
+/// Packed values are local to a process: they are not meant to be stored.
+
+/// Number of values sharing the same number of bits
+const size_t PACKED_LINE = 32;
+
+/// Pack the 'count' values of 'values', a multiple of PACKED_LINE, into
+/// 'packed' which is resized to the size used
+void packValues(const int16_t *values, size_t count,
+                std::vector<uint8_t> *packed);
+
+/// Restore the 'count' values packed in 'packed' by packValues
+void unpackValues(const uint8_t *packed, size_t count, int16_t *values);
+
+#endif // BRICK_PACKING_H
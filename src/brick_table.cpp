@@ -0,0 +1,103 @@
+#include "brick_table.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "thread_pool.h"
+
+BrickTable::BrickTable() : bricks_x(0), bricks_y(0), bricks_z(0) {}
+
+void BrickTable::build(const RawData &volume) {
+  if (volume.empty()) {
+    resize(0, 0, 0);
+    return;
+  }
+  resize(volume.width, volume.height, volume.depth);
+  updateLayers(volume, 0, volume.depth - 1);
+}
+
+void BrickTable::build(const PagedVolume &volume) {
+  if (volume.empty()) {
+    resize(0, 0, 0);
+    return;
+  }
+  resize(volume.width, volume.height, volume.depth);
+  updateLayers(volume, 0, volume.depth - 1);
+}
+
+void BrickTable::resize(int W, int H, int D) {
+  bricks_x = (W + BRICK_SIZE - 1) / BRICK_SIZE;
+  bricks_y = (H + BRICK_SIZE - 1) / BRICK_SIZE;
+  bricks_z = (D + BRICK_SIZE - 1) / BRICK_SIZE;
+  size_t nb_bricks = (size_t)bricks_x * bricks_y * bricks_z;
+  brick_min.resize(nb_bricks);
+  brick_max.resize(nb_bricks);
+}
+
+void BrickTable::updateLayers(const RawData &volume, int first_layer,
+                              int last_layer) {
+  if (brick_min.empty())
+    return;
+  // The range of a brick covers the first layer of the next brick
+  int first_bz = std::max(first_layer - 1, 0) / BRICK_SIZE;
+  int last_bz = std::min(last_layer / BRICK_SIZE, bricks_z - 1);
+  ThreadPool::getInstance().parallelFor(first_bz, last_bz + 1, [&](int bz) {
+    updateBrickLayer(volume.getLayer(bz * BRICK_SIZE), volume.width,
+                     volume.height, volume.depth, bz);
+  });
+}
+
+void BrickTable::updateLayers(const PagedVolume &volume, int first_layer,
+                              int last_layer) {
+  if (brick_min.empty())
+    return;
+  int W = volume.width;
+  int H = volume.height;
+  int D = volume.depth;
+  int first_bz = std::max(first_layer - 1, 0) / BRICK_SIZE;
+  int last_bz = std::min(last_layer / BRICK_SIZE, bricks_z - 1);
+  ThreadPool::getInstance().parallelFor(first_bz, last_bz + 1, [&](int bz) {
+    // The layers of the brick and the first layer of the next one
+    int first_z = bz * BRICK_SIZE;
+    int nb_layers = std::min(BRICK_SIZE + 1, D - first_z);
+    std::vector<int16_t> layers((size_t)W * H * nb_layers);
+    volume.copyRegion(0, 0, first_z, W, H, nb_layers, layers.data());
+    updateBrickLayer(layers.data(), W, H, D, bz);
+  });
+}
+
+void BrickTable::updateBrickLayer(const int16_t *layers, int W, int H, int D,
+                                  int bz) {
+  size_t first_brick = getIndex(0, 0, bz);
+  size_t layer_bricks = (size_t)bricks_x * bricks_y;
+  std::fill(brick_min.begin() + first_brick,
+            brick_min.begin() + first_brick + layer_bricks,
+            std::numeric_limits<int16_t>::max());
+  std::fill(brick_max.begin() + first_brick,
+            brick_max.begin() + first_brick + layer_bricks,
+            std::numeric_limits<int16_t>::lowest());
+  int z_end = std::min((bz + 1) * BRICK_SIZE, D - 1);
+  for (int z = bz * BRICK_SIZE; z <= z_end; z++) {
+    for (int y = 0; y < H; y++) {
+      const int16_t *line =
+          layers + ((size_t)(z - bz * BRICK_SIZE) * H + y) * W;
+      // A row is shared by two bricks when it starts a brick
+      int by_first = std::max(y - 1, 0) / BRICK_SIZE;
+      int by_last = std::min(y / BRICK_SIZE, bricks_y - 1);
+      for (int by = by_first; by <= by_last; by++) {
+        size_t brick_line = getIndex(0, by, bz);
+        for (int bx = 0; bx < bricks_x; bx++) {
+          int x_end = std::min((bx + 1) * BRICK_SIZE, W - 1);
+          int16_t min = brick_min[brick_line + bx];
+          int16_t max = brick_max[brick_line + bx];
+          for (int x = bx * BRICK_SIZE; x <= x_end; x++) {
+            min = std::min(min, line[x]);
+            max = std::max(max, line[x]);
+          }
+          brick_min[brick_line + bx] = min;
+          brick_max[brick_line + bx] = max;
+        }
+      }
+    }
+  }
+}
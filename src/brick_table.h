@@ -0,0 +1,65 @@
+#ifndef BRICK_TABLE_H
+#define BRICK_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "paged_volume.h"
+#include "raw_data.h"
+
+/// The extremum modality values of the bricks partitioning a volume
+///
+/// The volume is split in cubes of BRICK_SIZE voxels, the last bricks along
+/// each dimension may be smaller. The range of a brick also covers the first
+/// voxels of the next bricks, so that it bounds the values interpolated
+/// inside the brick. Renderers use it to skip whole bricks that are empty
+/// for the current window or transfer function.
+class BrickTable {
+public:
+  static const int BRICK_SIZE = 16;
+
+  BrickTable();
+
+  /// Compute the range of all the bricks of 'volume'
+  void build(const RawData &volume);
+  /// Compute the range of all the bricks of a paged volume, its layers are
+  /// read one layer of bricks at a time
+  void build(const PagedVolume &volume);
+
+  /// Recompute the range of the bricks containing the layers in
+  /// [first_layer, last_layer], the dimensions of 'volume' must be the ones
+  /// used on last build
+  void updateLayers(const RawData &volume, int first_layer, int last_layer);
+  void updateLayers(const PagedVolume &volume, int first_layer,
+                    int last_layer);
+
+  /// Number of bricks along each dimension
+  int getBricksX() const { return bricks_x; }
+  int getBricksY() const { return bricks_y; }
+  int getBricksZ() const { return bricks_z; }
+  size_t size() const { return brick_min.size(); }
+
+  size_t getIndex(int bx, int by, int bz) const {
+    return ((size_t)bz * bricks_y + by) * bricks_x + bx;
+  }
+
+  int16_t getMin(size_t brick_idx) const { return brick_min[brick_idx]; }
+  int16_t getMax(size_t brick_idx) const { return brick_max[brick_idx]; }
+  const std::vector<int16_t> &getMins() const { return brick_min; }
+  const std::vector<int16_t> &getMaxs() const { return brick_max; }
+
+private:
+  int bricks_x, bricks_y, bricks_z;
+  std::vector<int16_t> brick_min;
+  std::vector<int16_t> brick_max;
+
+  /// Allocate the ranges of the bricks of a W*H*D volume
+  void resize(int W, int H, int D);
+  /// Compute the range of the bricks of the layer of bricks 'bz' of a W*H*D
+  /// volume, 'layers' holds the layers of the volume from the first layer of
+  /// the brick
+  void updateBrickLayer(const int16_t *layers, int W, int H, int D, int bz);
+};
+
+#endif // BRICK_TABLE_H
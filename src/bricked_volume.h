@@ -0,0 +1,152 @@
+#ifndef BRICKED_VOLUME_H
+#define BRICKED_VOLUME_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "thread_pool.h"
+#include "volume.h"
+
+/// A volume of values of type T stored in cubic bricks
+///
+/// Bricks are stored column by column, line by line, then slice by slice, and
+/// so are the voxels inside each brick. The neighbours of a voxel along any
+/// axis are then close in memory, which favors sagittal access and rays
+/// crossing the volume at any angle, while walking along rows gets slower.
+/// The volume is padded with 0 up to whole bricks.
+///
+/// Indices are the sum of an offset per column, row and layer read from
+/// small tables, which is cheaper than decomposing the coordinates.
+///
+/// The accessors of Volume which do not depend on the layout are provided,
+/// rows and layers are not contiguous anymore. Volumes can only be moved.
+template <typename T> class BrickedVolume {
+public:
+  /// log2 of the side of the bricks
+  static const int BRICK_SHIFT = 3;
+  /// Side of the bricks [voxels], a brick of int16_t spans 16 cache lines
+  static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+  static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+  int width;
+  int height;
+  int depth;
+  /// The size of the voxels [mm]
+  double pixel_width;
+  double pixel_height;
+  double slice_spacing;
+  /// The window applied to the values, in modality values
+  double window_center;
+  double window_width;
+
+  /// An empty volume
+  BrickedVolume();
+  /// A copy of 'volume' in bricks, the layers are converted in parallel
+  explicit BrickedVolume(const Volume<T> &volume);
+  BrickedVolume(BrickedVolume &&other) = default;
+  BrickedVolume &operator=(BrickedVolume &&other) = default;
+  BrickedVolume(const BrickedVolume &other) = delete;
+  BrickedVolume &operator=(const BrickedVolume &other) = delete;
+
+  /// Copy the layers [first_layer, last_layer] of 'volume', which has the
+  /// same size as this volume
+  void copyLayers(const Volume<T> &volume, int first_layer, int last_layer);
+
+  T *data() { return values.data(); }
+  const T *data() const { return values.data(); }
+  /// Number of values stored, including the padding
+  size_t size() const { return values.size(); }
+  bool empty() const { return values.size() == 0; }
+
+  /// Number of bricks along each axis
+  int getBricksX() const { return bricks_x; }
+  int getBricksY() const { return bricks_y; }
+  int getBricksZ() const { return bricks_z; }
+
+  /// Position of the voxel in the values
+  size_t getIndex(int col, int row, int layer) const {
+    return col_offsets[col] + row_offsets[row] + layer_offsets[layer];
+  }
+  T getValue(int col, int row, int layer) const {
+    return data()[getIndex(col, row, layer)];
+  }
+
+  /// The BRICK_VOXELS values of the brick at (bx, by, bz)
+  const T *getBrick(int bx, int by, int bz) const {
+    return data() + getIndex(bx * BRICK_SIZE, by * BRICK_SIZE, bz * BRICK_SIZE);
+  }
+
+private:
+  int bricks_x;
+  int bricks_y;
+  int bricks_z;
+  /// The offset of each column, row and layer in the values, their sum is
+  /// the index of a voxel
+  std::vector<size_t> col_offsets;
+  std::vector<size_t> row_offsets;
+  std::vector<size_t> layer_offsets;
+  AlignedArray<T> values;
+};
+
+template <typename T>
+BrickedVolume<T>::BrickedVolume()
+    : width(-1), height(-1), depth(-1), pixel_width(-1), pixel_height(-1),
+      slice_spacing(0), window_center(0), window_width(1), bricks_x(0),
+      bricks_y(0), bricks_z(0) {}
+
+template <typename T>
+BrickedVolume<T>::BrickedVolume(const Volume<T> &volume)
+    : width(volume.width), height(volume.height), depth(volume.depth),
+      pixel_width(volume.pixel_width), pixel_height(volume.pixel_height),
+      slice_spacing(volume.slice_spacing),
+      window_center(volume.window_center), window_width(volume.window_width),
+      bricks_x(0), bricks_y(0), bricks_z(0) {
+  if (volume.empty())
+    return;
+  bricks_x = (width + BRICK_SIZE - 1) / BRICK_SIZE;
+  bricks_y = (height + BRICK_SIZE - 1) / BRICK_SIZE;
+  bricks_z = (depth + BRICK_SIZE - 1) / BRICK_SIZE;
+  values.allocate((size_t)bricks_x * bricks_y * bricks_z * BRICK_VOXELS, true);
+  const int mask = BRICK_SIZE - 1;
+  size_t brick_row = (size_t)bricks_x * BRICK_VOXELS;
+  size_t brick_layer = brick_row * bricks_y;
+  col_offsets.resize(width);
+  for (int x = 0; x < width; x++) {
+    col_offsets[x] = (size_t)(x >> BRICK_SHIFT) * BRICK_VOXELS + (x & mask);
+  }
+  row_offsets.resize(height);
+  for (int y = 0; y < height; y++) {
+    row_offsets[y] = (y >> BRICK_SHIFT) * brick_row + (y & mask) * BRICK_SIZE;
+  }
+  layer_offsets.resize(depth);
+  for (int z = 0; z < depth; z++) {
+    layer_offsets[z] = (z >> BRICK_SHIFT) * brick_layer +
+                       (z & mask) * BRICK_SIZE * BRICK_SIZE;
+  }
+  copyLayers(volume, 0, depth - 1);
+}
+
+template <typename T>
+void BrickedVolume<T>::copyLayers(const Volume<T> &volume, int first_layer,
+                                  int last_layer) {
+  first_layer = std::max(first_layer, 0);
+  last_layer = std::min(last_layer, depth - 1);
+  if (empty() || first_layer > last_layer)
+    return;
+  const int brick_size = BRICK_SIZE;
+  // Each layer is written by a single task, rows are split in brick rows
+  ThreadPool::getInstance().parallelFor(
+      first_layer, last_layer + 1, [&](int z) {
+        for (int y = 0; y < height; y++) {
+          const T *row = volume.getRow(y, z);
+          for (int x = 0; x < width; x += brick_size) {
+            int count = std::min(brick_size, width - x);
+            std::memcpy(data() + getIndex(x, y, z), row + x,
+                        count * sizeof(T));
+          }
+        }
+      });
+}
+
+#endif // BRICKED_VOLUME_H
@@ -0,0 +1,122 @@
+#include "collection_decoder.h"
+
+#include "thread_pool.h"
+
+CollectionDecoder::CollectionDecoder(QObject *parent)
+    : QObject(parent), generation(0), nb_files(0), nb_decoded(0), nb_tasks(0),
+      notify_pending(false) {}
+
+CollectionDecoder::~CollectionDecoder() {
+  cancel();
+  // Tasks of cancelled runs return immediately, but they refer to this
+  std::unique_lock<std::mutex> lock(mutex);
+  idle_cond.wait(lock, [this]() { return nb_tasks == 0; });
+}
+
+void CollectionDecoder::start(DicomCollection *collection) {
+  std::lock_guard<std::mutex> lock(mutex);
+  generation++;
+  nb_files = (int)collection->files.size();
+  nb_decoded = 0;
+  notify_pending = false;
+  batch = Batch();
+  int width = collection->width;
+  int height = collection->height;
+  for (auto &entry : collection->files) {
+    int instance = entry.first;
+    // Tasks have to be copyable, the file is moved in when running
+    std::shared_ptr<std::unique_ptr<DcmFileFormat>> file =
+        std::make_shared<std::unique_ptr<DcmFileFormat>>(
+            std::move(entry.second));
+    std::string path = collection->file_paths[instance];
+    offile_off_t pixel_data_offset = collection->pixel_data_offsets[instance];
+    int task_generation = generation;
+    nb_tasks++;
+    ThreadPool::getInstance().submit([=]() {
+      decode(task_generation, instance, std::move(*file), path,
+             pixel_data_offset, width, height);
+    });
+  }
+  collection->files.clear();
+}
+
+void CollectionDecoder::cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  generation++;
+  nb_files = 0;
+  nb_decoded = 0;
+  batch = Batch();
+}
+
+bool CollectionDecoder::isRunning() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nb_decoded < nb_files;
+}
+
+int CollectionDecoder::getNbDecoded() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nb_decoded;
+}
+
+int CollectionDecoder::getNbFiles() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nb_files;
+}
+
+CollectionDecoder::Batch CollectionDecoder::takeBatch() {
+  std::lock_guard<std::mutex> lock(mutex);
+  Batch result = std::move(batch);
+  batch = Batch();
+  return result;
+}
+
+void CollectionDecoder::decode(int task_generation, int instance,
+                               std::unique_ptr<DcmFileFormat> file,
+                               const std::string &path,
+                               offile_off_t pixel_data_offset, int width,
+                               int height) {
+  bool cancelled;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = task_generation != generation;
+  }
+  DicomCollection::DecodedSlice slice;
+  if (!cancelled)
+    slice = DicomCollection::decodeFile(path, file.get(), pixel_data_offset,
+                                        width, height);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!cancelled && task_generation == generation) {
+    batch.files[instance] = std::move(file);
+    batch.slices[instance] = std::move(slice);
+    nb_decoded++;
+    if (!notify_pending) {
+      notify_pending = true;
+      QMetaObject::invokeMethod(
+          this, [this, task_generation]() { notify(task_generation); },
+          Qt::QueuedConnection);
+    }
+  }
+  nb_tasks--;
+  idle_cond.notify_all();
+}
+
+void CollectionDecoder::notify(int task_generation) {
+  bool done;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task_generation != generation)
+      return;
+    notify_pending = false;
+    done = nb_decoded == nb_files;
+  }
+  emit slicesDecoded();
+  if (!done)
+    return;
+  // The owner may have cancelled the decoding while handling the slices
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task_generation != generation)
+      return;
+  }
+  emit finished();
+}
@@ -0,0 +1,82 @@
+#ifndef COLLECTION_DECODER_H
+#define COLLECTION_DECODER_H
+
+#include <QObject>
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "dicom_collection.h"
+
+/// Decode the files of a DicomCollection in the background
+///
+/// Each file is decoded by a task of the ThreadPool. The results are
+/// gathered in a batch and the owner is notified through its event loop, a
+/// single notification covering all the slices decoded meanwhile. The owner
+/// takes the batch and inserts the slices in its volume on its own thread.
+class CollectionDecoder : public QObject {
+  Q_OBJECT
+public:
+  /// The results available since the last call to takeBatch, indexed by
+  /// instance number
+  struct Batch {
+    /// The headers of the files once decoded, whatever the result
+    std::map<int, std::unique_ptr<DcmFileFormat>> files;
+    std::map<int, DicomCollection::DecodedSlice> slices;
+  };
+
+  explicit CollectionDecoder(QObject *parent = 0);
+  /// Cancel the decoding and wait for the running tasks
+  ~CollectionDecoder();
+
+  /// Decode the files of 'collection' after loadHeaders succeeded, the
+  /// decoder takes the ownership of the files. A running decoding is
+  /// cancelled.
+  void start(DicomCollection *collection);
+  /// Stop decoding, the files which were not decoded yet are discarded
+  void cancel();
+
+  /// True until all the files are decoded or the decoding is cancelled
+  bool isRunning() const;
+  /// Number of files decoded since start
+  int getNbDecoded() const;
+  /// Number of files to decode since start
+  int getNbFiles() const;
+
+  /// Retrieve the results gathered since the last call
+  Batch takeBatch();
+
+signals:
+  /// New results can be retrieved with takeBatch
+  void slicesDecoded();
+  /// All the files were decoded, emitted after the last slicesDecoded
+  void finished();
+
+private:
+  /// Protects all the members below
+  mutable std::mutex mutex;
+  std::condition_variable idle_cond;
+  /// Incremented on start and cancel, tasks of older runs only release
+  /// their file
+  int generation;
+  int nb_files;
+  int nb_decoded;
+  /// Number of tasks queued or running, of any generation
+  int nb_tasks;
+  /// True if a notification was posted and not delivered yet
+  bool notify_pending;
+  Batch batch;
+
+  /// Decode the file at 'path' whose header is 'file', called by the tasks
+  /// of 'task_generation'
+  void decode(int task_generation, int instance,
+              std::unique_ptr<DcmFileFormat> file, const std::string &path,
+              offile_off_t pixel_data_offset, int width, int height);
+  /// Emit the signals for the results of 'task_generation', called through
+  /// the event loop
+  void notify(int task_generation);
+};
+
+#endif // COLLECTION_DECODER_H
@@ -0,0 +1,495 @@
+#include "dicom_collection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <sstream>
+
+#include <dcmtk/dcmdata/dcistrmf.h>
+#include <dcmtk/dcmimgle/dipixel.h>
+
+#include "thread_pool.h"
+
+/// Copy 'count' values from 'src' to 'dst', saturating them to int16 range.
+/// decodeFile rejects the images whose values would be saturated.
+template <typename T>
+static void toModalityValues(const T *src, size_t count, int16_t *dst) {
+  for (size_t i = 0; i < count; i++) {
+    double value = src[i];
+    dst[i] = (int16_t)std::min(std::max(value, -32768.0), 32767.0);
+  }
+}
+
+DicomCollection::DicomCollection()
+    : memory_budget(PagedVolume::getDefaultMemoryBudget()),
+      compress_volume(false), min_value(std::numeric_limits<double>::max()),
+      max_value(std::numeric_limits<double>::lowest()), width(-1), height(-1),
+      window_center(0), window_width(1), pixel_width(-1), pixel_height(-1),
+      slice_spacing(0), min_instance(std::numeric_limits<int>::max()),
+      max_instance(std::numeric_limits<int>::lowest()) {}
+
+bool DicomCollection::load(const std::vector<std::string> &paths,
+                           std::string *error_title, std::string *error_msg) {
+  if (!loadHeaders(paths, error_title, error_msg))
+    return false;
+  // Decoding the files on all the cores by batches, so that the decoded
+  // slices never hold the whole volume. Results are checked in the order of
+  // the instances.
+  std::vector<int> instances;
+  for (const auto &entry : files) {
+    instances.push_back(entry.first);
+  }
+  int batch_size = 4 * ThreadPool::getInstance().size();
+  for (int first = 0; first < (int)instances.size(); first += batch_size) {
+    int last = std::min(first + batch_size, (int)instances.size());
+    std::vector<DecodedSlice> slices(last - first);
+    ThreadPool::getInstance().parallelFor(first, last, [&](int idx) {
+      int instance = instances[idx];
+      slices[idx - first] =
+          decodeFile(file_paths.at(instance), files.at(instance).get(),
+                     pixel_data_offsets.at(instance), width, height);
+    });
+    for (int idx = first; idx < last; idx++) {
+      const DecodedSlice &slice = slices[idx - first];
+      if (!slice.ok) {
+        *error_title = slice.error_title;
+        *error_msg = slice.error_msg;
+        return false;
+      }
+      min_value = std::min(slice.min_value, min_value);
+      max_value = std::max(slice.max_value, max_value);
+      int layer = instances[idx] - min_instance;
+      if (paged_volume)
+        paged_volume->setLayer(slice.values.data(), layer);
+      else
+        volume->setLayer(slice.values.data(), layer);
+    }
+  }
+  releaseUnpackedBricks();
+  return true;
+}
+
+bool DicomCollection::loadHeaders(const std::vector<std::string> &paths,
+                                  std::string *error_title,
+                                  std::string *error_msg) {
+  // Parsing the files on all the cores, results are then validated in the
+  // order of the paths
+  std::vector<LoadedFile> loaded_files(paths.size());
+  ThreadPool::getInstance().parallelFor(
+      0, (int)paths.size(), [&](int file_idx) {
+        loaded_files[file_idx] = readDicomFile(paths[file_idx]);
+      });
+  for (size_t file_idx = 0; file_idx < loaded_files.size(); file_idx++) {
+    const std::string &path = paths[file_idx];
+    LoadedFile &loaded = loaded_files[file_idx];
+    if (!loaded.ok) {
+      *error_title = "Failed to open file";
+      *error_msg = path;
+      return false;
+    }
+    // Checking patient
+    const std::string &file_patient = loaded.patient_name;
+    if (patient_name == "") {
+      patient_name = file_patient;
+    } else if (patient_name != file_patient) {
+      *error_title = "Invalid file collection";
+      *error_msg = "At least 2 patients are present in the file collection: '" +
+                   patient_name + "' and '" + file_patient + "'";
+      return false;
+    }
+
+    int instance_number = loaded.instance_number;
+    // Checking that instance number is not duplicated
+    if (files.count(instance_number) > 0) {
+      *error_title = "Duplicated instance idx";
+      *error_msg = "Instance " + std::to_string(instance_number) +
+                   " is already loaded, cancelling load";
+      return false;
+    }
+    // All the images should share the same size
+    if (file_idx == 0) {
+      width = loaded.width;
+      height = loaded.height;
+    } else if (width != loaded.width || height != loaded.height) {
+      std::ostringstream msg_oss;
+      msg_oss << "Multiple image sizes found: " << width << "*" << height
+              << " and " << loaded.width << "*" << loaded.height;
+      *error_title = "Inconsistent collection";
+      *error_msg = msg_oss.str();
+      return false;
+    }
+    files[instance_number] = std::move(loaded.file);
+    file_paths[instance_number] = path;
+    pixel_data_offsets[instance_number] = loaded.pixel_data_offset;
+    // Updating/checking pixel_width
+    double frame_pixel_height = loaded.pixel_spacing[0];
+    double frame_pixel_width = loaded.pixel_spacing[1];
+    if (file_idx == 0) {
+      pixel_width = frame_pixel_width;
+      pixel_height = frame_pixel_height;
+    } else if (pixel_width != frame_pixel_width ||
+               pixel_height != frame_pixel_height) {
+      std::ostringstream msg_oss;
+      msg_oss << "Multiple pixel sizes found: " << pixel_width << "*"
+              << pixel_height << " and " << frame_pixel_width << "*"
+              << frame_pixel_height;
+      *error_title = "Inconsistent collection";
+      *error_msg = msg_oss.str();
+      return false;
+    }
+  }
+  if (files.empty()) {
+    *error_title = "Invalid file collection";
+    *error_msg = "No file provided";
+    return false;
+  }
+  min_instance = files.begin()->first;
+  max_instance = files.rbegin()->first;
+  DcmDataset *first_dataset = files.begin()->second->getDataset();
+  window_center = getField<double>(first_dataset, DcmTagKey(0x28, 0x1050));
+  window_width = getField<double>(first_dataset, DcmTagKey(0x28, 0x1051));
+  // Check slice_spacing consistency
+  double slice_offset(0);
+  if (files.size() <= 1) {
+    slice_spacing = 0;
+  } else {
+    // Deducing layer spacing and offset from extremum layers
+    std::vector<double> first_layer_position =
+        getImagePosition(files.begin()->second->getDataset());
+    std::vector<double> last_layer_position =
+        getImagePosition(files.rbegin()->second->getDataset());
+    slice_spacing = (last_layer_position[2] - first_layer_position[2]) /
+                    (max_instance - min_instance);
+    slice_offset = first_layer_position[2] - min_instance * slice_spacing;
+    // Checking that all layers roughly respect the provided their expected
+    // position
+    double max_tol = 0.01; //[mm]
+    for (const auto &entry : files) {
+      double expected_z = slice_spacing * entry.first + slice_offset;
+      double received_z = getImagePosition(entry.second->getDataset())[2];
+      double error_z = fabs(expected_z - received_z);
+      if (error_z > max_tol) {
+        *error_title = "Inconsistent collection";
+        *error_msg = "Slices are not regularly spaced, error: " +
+                     std::to_string(error_z);
+        return false;
+      }
+    }
+  }
+
+  // Allocating the volume, missing instances are left empty. Volumes which
+  // do not fit in memory are paged to disk, compressed ones are packed.
+  int depth = getExpectedInstances();
+  size_t volume_size = (size_t)width * height * depth * sizeof(int16_t);
+  volume.reset();
+  paged_volume.reset();
+  PagedVolume::Storage storage = PagedVolume::DISK;
+  if (volume_size <= memory_budget && compress_volume) {
+    storage = PagedVolume::PACKED;
+  } else if (volume_size <= memory_budget) {
+    try {
+      volume.reset(new RawData(width, height, depth));
+      volume->pixel_width = pixel_width;
+      volume->pixel_height = pixel_height;
+      volume->slice_spacing = slice_spacing;
+      return true;
+    } catch (const std::bad_alloc &) {
+      volume.reset();
+    }
+  }
+  paged_volume = std::make_shared<PagedVolume>();
+  if (!paged_volume->create(width, height, depth, memory_budget, storage)) {
+    paged_volume.reset();
+    *error_title = "Volume too large";
+    *error_msg = "Can't allocate the volume nor create its file on disk";
+    return false;
+  }
+  // Packed volumes only keep a layer of bricks unpacked: slices decoded in
+  // order pack each brick once, and the axial view reads a single layer
+  if (storage == PagedVolume::PACKED)
+    paged_volume->setMemoryBudget(paged_volume->getBrickLayerSize());
+  paged_volume->pixel_width = pixel_width;
+  paged_volume->pixel_height = pixel_height;
+  paged_volume->slice_spacing = slice_spacing;
+  return true;
+}
+
+void DicomCollection::releaseUnpackedBricks() {
+  if (!paged_volume || paged_volume->getStorage() != PagedVolume::PACKED)
+    return;
+  // The 2D views and the ray caster only need the bricks they cross, a few
+  // planes of bricks are enough to keep them from unpacking twice
+  size_t volume_size = (size_t)paged_volume->width * paged_volume->height *
+                       paged_volume->depth * sizeof(int16_t);
+  size_t brick_size = PagedVolume::BRICK_VOXELS * sizeof(int16_t);
+  paged_volume->setMemoryBudget(std::max(volume_size / 64, 8 * brick_size));
+}
+
+DicomCollection::DecodedSlice
+DicomCollection::decodeFile(const std::string &path, DcmFileFormat *header,
+                            offile_off_t pixel_data_offset, int width,
+                            int height) {
+  DecodedSlice slice;
+  slice.ok = false;
+  // The pixel data only lives until its values are extracted, the header
+  // read by loadHeaders is the one kept. The elements before the pixel data
+  // are not parsed twice when possible.
+  std::unique_ptr<DcmDataset> resumed =
+      readPixelData(path, header, pixel_data_offset);
+  DcmFileFormat file;
+  DcmDataset *dataset = resumed.get();
+  OFCondition status;
+  if (!dataset) {
+    status = file.loadFile(path.c_str());
+    if (status.bad()) {
+      slice.error_title = "Failed to open file";
+      slice.error_msg = path;
+      return slice;
+    }
+    dataset = file.getDataset();
+  }
+  std::unique_ptr<DicomImage> img(decodeDicomImage(dataset, &status));
+  // All the Dicom file should contain loadable images
+  if (!img) {
+    slice.error_title = "Invalid file";
+    slice.error_msg = "Can't read image at file " + path + ": " + status.text();
+    return slice;
+  }
+  if ((int)img->getWidth() != width || (int)img->getHeight() != height) {
+    std::ostringstream msg_oss;
+    msg_oss << "Image size " << img->getWidth() << "*" << img->getHeight()
+            << " does not match the header size " << width << "*" << height
+            << " at file " << path;
+    slice.error_title = "Inconsistent collection";
+    slice.error_msg = msg_oss.str();
+    return slice;
+  }
+  // Values are stored on 16-bit signed integers, clipping them would make
+  // the volume disagree with the range and the window of the collection
+  getFrameMinMax(img.get(), &slice.min_value, &slice.max_value);
+  if (slice.min_value < std::numeric_limits<int16_t>::min() ||
+      slice.max_value > std::numeric_limits<int16_t>::max()) {
+    std::ostringstream msg_oss;
+    msg_oss << "Modality values in [" << slice.min_value << ", "
+            << slice.max_value << "] at file " << path
+            << " exceed the supported range [-32768, 32767]";
+    slice.error_title = "Unsupported values";
+    slice.error_msg = msg_oss.str();
+    return slice;
+  }
+  if (!getModalityValues(img.get(), &slice.values)) {
+    slice.error_title = "Invalid file";
+    slice.error_msg = "Can't read modality values at file " + path;
+    return slice;
+  }
+  slice.ok = true;
+  return slice;
+}
+
+int DicomCollection::getExpectedInstances() const {
+  return max_instance - min_instance + 1;
+}
+
+DicomImage *DicomCollection::decodeDicomImage(DcmDataset *dataset,
+                                              OFCondition *status) {
+  // Changing syntax to a common one
+  E_TransferSyntax wished_ts = EXS_LittleEndianExplicit;
+  *status = dataset->chooseRepresentation(wished_ts, NULL);
+  if (status->bad()) {
+    return nullptr;
+  }
+  return new DicomImage(dataset, wished_ts);
+}
+
+std::unique_ptr<DcmFileFormat>
+DicomCollection::readHeader(const std::string &path,
+                            offile_off_t *pixel_data_offset) {
+  DcmInputFileStream stream(path.c_str());
+  if (stream.status().bad())
+    return nullptr;
+  // Only the header is needed, parsing stops before the pixel data and
+  // leaves the stream at its tag
+  std::unique_ptr<DcmFileFormat> file(new DcmFileFormat());
+  file->transferInit();
+  OFCondition status = file->readUntilTag(stream, EXS_Unknown, EGL_noChange,
+                                          DCM_MaxReadLength, DCM_PixelData);
+  file->transferEnd();
+  if (status.bad())
+    return nullptr;
+  if (pixel_data_offset)
+    *pixel_data_offset = stream.eos() ? 0 : stream.tell();
+  return file;
+}
+
+std::unique_ptr<DcmDataset>
+DicomCollection::readPixelData(const std::string &path, DcmFileFormat *header,
+                               offile_off_t pixel_data_offset) {
+  if (!header || pixel_data_offset <= 0)
+    return nullptr;
+  // Deflated datasets can't be read from the middle of the file
+  E_TransferSyntax xfer = header->getDataset()->getOriginalXfer();
+  if (xfer == EXS_Unknown || xfer == EXS_DeflatedLittleEndianExplicit)
+    return nullptr;
+  DcmInputFileStream stream(path.c_str(), pixel_data_offset);
+  if (stream.status().bad())
+    return nullptr;
+  // The elements from the pixel data to the end of the file
+  DcmDataset tail;
+  tail.transferInit();
+  OFCondition status = tail.read(stream, xfer);
+  tail.transferEnd();
+  // A wrong offset gives an error or a dataset without pixel data
+  DcmElement *pixel_data = status.good() ? tail.remove(DCM_PixelData) : nullptr;
+  if (!pixel_data)
+    return nullptr;
+  std::unique_ptr<DcmDataset> dataset(new DcmDataset(*header->getDataset()));
+  if (dataset->insert(pixel_data).bad()) {
+    delete pixel_data;
+    return nullptr;
+  }
+  return dataset;
+}
+
+DicomCollection::LoadedFile
+DicomCollection::readDicomFile(const std::string &path) {
+  LoadedFile loaded;
+  loaded.ok = false;
+  loaded.pixel_data_offset = 0;
+  loaded.file = readHeader(path, &loaded.pixel_data_offset);
+  if (!loaded.file)
+    return loaded;
+  DcmDataset *file_ds = loaded.file->getDataset();
+  loaded.patient_name = getPatientName(file_ds);
+  loaded.instance_number = getInstanceNumber(file_ds);
+  // Rows and Columns
+  loaded.width = getField<unsigned short>(file_ds, DcmTagKey(0x28, 0x11));
+  loaded.height = getField<unsigned short>(file_ds, DcmTagKey(0x28, 0x10));
+  loaded.pixel_spacing = getPixelSpacing(file_ds);
+  loaded.ok = true;
+  return loaded;
+}
+
+bool DicomCollection::getModalityValues(DicomImage *img,
+                                        std::vector<int16_t> *values) {
+  if (!img->isMonochrome())
+    return false;
+  const DiPixel *inter_data = img->getInterData();
+  if (inter_data == nullptr)
+    return false;
+  size_t count = img->getWidth() * img->getHeight();
+  if (inter_data->getCount() < count)
+    return false;
+  values->resize(count);
+  const void *src = inter_data->getData();
+  switch (inter_data->getRepresentation()) {
+    case EPR_Uint8:
+      toModalityValues((const Uint8 *)src, count, values->data());
+      break;
+    case EPR_Sint8:
+      toModalityValues((const Sint8 *)src, count, values->data());
+      break;
+    case EPR_Uint16:
+      toModalityValues((const Uint16 *)src, count, values->data());
+      break;
+    case EPR_Sint16:
+      toModalityValues((const Sint16 *)src, count, values->data());
+      break;
+    case EPR_Uint32:
+      toModalityValues((const Uint32 *)src, count, values->data());
+      break;
+    case EPR_Sint32:
+      toModalityValues((const Sint32 *)src, count, values->data());
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+std::string DicomCollection::getPatientName(DcmDataset *ds) {
+  return getField<std::string>(ds, DCM_PatientName);
+}
+
+std::vector<double> DicomCollection::getPixelSpacing(DcmDataset *dataset) {
+  return getFieldVector<double>(dataset, DcmTagKey(0x28, 0x30), 2);
+}
+
+std::vector<double>
+DicomCollection::getImagePosition(DcmDataset *dataset) {
+  return getFieldVector<double>(dataset, DcmTagKey(0x20, 0x32), 3);
+}
+
+void DicomCollection::getFrameMinMax(DicomImage *img, double *min,
+                                     double *max) {
+  int used_values_mode = 0;
+  img->getMinMaxValues(*min, *max, used_values_mode);
+}
+
+int DicomCollection::getSeriesNumber(DcmDataset *dataset) {
+  return getField<int>(dataset, 0x20, 0x11);
+}
+
+int DicomCollection::getInstanceNumber(DcmDataset *dataset) {
+  return getField<int>(dataset, 0x20, 0x13);
+}
+
+int DicomCollection::getAcquisitionNumber(DcmDataset *dataset) {
+  return getField<int>(dataset, 0x20, 0x12);
+}
+
+/*///////////////
+/// TEMPLATES ///
+///////////////*/
+
+template <>
+double getField<double>(DcmItem *item, const DcmTagKey &tag_key,
+                        unsigned long pos) {
+  double value;
+  OFCondition status = item->findAndGetFloat64(tag_key, value, pos);
+  if (status.bad())
+    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
+              << std::endl;
+  return value;
+}
+template <>
+short int getField<short int>(DcmItem *item, const DcmTagKey &tag_key,
+                              unsigned long pos) {
+  short int value;
+  OFCondition status = item->findAndGetSint16(tag_key, value, pos);
+  if (status.bad())
+    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
+              << std::endl;
+  return value;
+}
+template <>
+unsigned short getField<unsigned short>(DcmItem *item,
+                                        const DcmTagKey &tag_key,
+                                        unsigned long pos) {
+  Uint16 value = 0;
+  OFCondition status = item->findAndGetUint16(tag_key, value, pos);
+  if (status.bad())
+    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
+              << std::endl;
+  return value;
+}
+template <>
+int getField<int>(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos) {
+  int value;
+  OFCondition status = item->findAndGetSint32(tag_key, value, pos);
+  if (status.bad())
+    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
+              << std::endl;
+  return value;
+}
+template <>
+std::string getField<std::string>(DcmItem *item, const DcmTagKey &tag_key,
+                                  unsigned long pos) {
+  OFString value;
+  OFCondition status = item->findAndGetOFStringArray(tag_key, value, pos);
+  if (status.bad())
+    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
+              << std::endl;
+  return value.c_str();
+}
\ No newline at end of file
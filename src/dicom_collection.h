@@ -0,0 +1,222 @@
+#ifndef DICOM_COLLECTION_H
+#define DICOM_COLLECTION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dcmtk/dcmdata/dctk.h>
+#include <dcmtk/dcmimgle/dcmimage.h>
+
+#include "paged_volume.h"
+#include "raw_data.h"
+
+/// A set of Dicom files describing the slices of a single volume
+///
+/// The collection is loaded and validated without any user interaction, so it
+/// can be used both by the GUI and by command-line tools. Loading is made of
+/// two stages which can be run separately to show the slices as they are
+/// decoded:
+/// - loadHeaders: the files are read and validated, the geometry is known
+/// - decodeFile: the modality values of each file are extracted
+///
+/// Only the header elements of the files are kept in memory, the pixel data
+/// is released once copied in the volume. Volumes larger than memory_budget,
+/// or which can't be allocated, are paged to disk instead. Volumes which fit
+/// can be kept packed in memory with compress_volume.
+class DicomCollection {
+public:
+  /// The modality values decoded from one file
+  struct DecodedSlice {
+    /// False if the values could not be extracted, 'error_title' and
+    /// 'error_msg' then describe the problem
+    bool ok;
+    std::string error_title;
+    std::string error_msg;
+    std::vector<int16_t> values;
+    double min_value;
+    double max_value;
+  };
+
+  DicomCollection();
+
+  /// Read all the files at 'paths' and build the volume from their modality
+  /// values. On failure, return false and fill 'error_title' and 'error_msg'
+  /// with a description of the first problem encountered, the collection
+  /// should then be discarded.
+  bool load(const std::vector<std::string> &paths, std::string *error_title,
+            std::string *error_msg);
+
+  /// Read and validate all the files at 'paths' without decoding their
+  /// pixel data: each file is only parsed up to its Pixel Data element. On
+  /// success, the volume (or the paged volume) is allocated with the final
+  /// geometry and filled with 0, min_value and max_value are not known yet.
+  /// On failure, return false as load does.
+  bool loadHeaders(const std::vector<std::string> &paths,
+                   std::string *error_title, std::string *error_msg);
+
+  /// Extract the modality values of the file at 'path', the parsed pixel
+  /// data is discarded afterwards. Parsing resumes at 'pixel_data_offset'
+  /// with the elements of 'header' when both are known, the whole file is
+  /// parsed again otherwise. Images are expected to have a size of 'width' *
+  /// 'height', with modality values fitting in int16_t (e.g. unsigned images
+  /// above 32767 are rejected rather than clipped). Files can be decoded in
+  /// parallel, each by a single thread, 'header' is not modified.
+  static DecodedSlice decodeFile(const std::string &path,
+                                 DcmFileFormat *header,
+                                 offile_off_t pixel_data_offset, int width,
+                                 int height);
+
+  /// Once the slices are decoded, reduce the unpacked bricks of a packed
+  /// volume to a small share of the volume, the rest of it stays packed
+  void releaseUnpackedBricks();
+
+  /// Parse the header of the file at 'path', stopping before the pixel data
+  /// Return nullptr if the file can't be read. If 'pixel_data_offset' is not
+  /// null, it receives the position of the Pixel Data element in the file,
+  /// 0 if the file has none.
+  static std::unique_ptr<DcmFileFormat>
+  readHeader(const std::string &path,
+             offile_off_t *pixel_data_offset = nullptr);
+
+  /// Number of instances between min_instance and max_instance (included)
+  int getExpectedInstances() const;
+
+  /// The header elements of the files of the collection, parsed up to the
+  /// pixel data, indexed by instance number
+  std::map<int, std::unique_ptr<DcmFileFormat>> files;
+  /// The path of each file, indexed by instance number
+  std::map<int, std::string> file_paths;
+  /// The position of the Pixel Data element in each file, where decodeFile
+  /// resumes parsing, indexed by instance number
+  std::map<int, offile_off_t> pixel_data_offsets;
+
+  /// The modality values of the whole collection, missing instances are
+  /// filled with 0
+  std::shared_ptr<RawData> volume;
+  /// The modality values of collections too large for memory, or packed in
+  /// memory, volume is then null
+  std::shared_ptr<PagedVolume> paged_volume;
+  /// Maximal size of the modality values kept in memory [bytes], half of the
+  /// physical memory by default. Paged volumes keep this size of bricks.
+  size_t memory_budget;
+  /// If true, volumes fitting in memory_budget are stored with
+  /// PagedVolume::PACKED, only a layer of bricks staying unpacked while
+  /// decoding and 1/64 of the volume afterwards. False by default.
+  bool compress_volume;
+
+  /// The name of the patient the collection concerns
+  std::string patient_name;
+  /// Minimal value used among the whole collection
+  double min_value;
+  /// Maximal value used among the whole collection
+  double max_value;
+  /// The size of the images [px]
+  int width;
+  int height;
+  /// The window suggested by the file with the lowest instance number
+  double window_center;
+  double window_width;
+  /// The width of a pixel in [mm]
+  double pixel_width;
+  /// The height of a pixel in [mm]
+  double pixel_height;
+  /// The space between two consecutive slices [mm]
+  /// - 0 if less than 2 images are loaded
+  double slice_spacing;
+  /// The lowest instance number among files
+  int min_instance;
+  /// The highest instance number among files
+  int max_instance;
+
+  /// Retrieve the image from the given dataset without any user interaction
+  /// On failure, return nullptr and 'status' describes the error
+  static DicomImage *decodeDicomImage(DcmDataset *dataset,
+                                      OFCondition *status);
+
+  /// Retrieve patient name from the dataset
+  /// return 'FAIL' if the field can't be read
+  static std::string getPatientName(DcmDataset *dataset);
+
+  // Returns a two elements vector with [row_spacing, col_spacing] in mm
+  static std::vector<double> getPixelSpacing(DcmDataset *dataset);
+
+  // Returns the position of the first voxel transmitted in a three elements
+  // vector with [x,y,z] in mm
+  static std::vector<double> getImagePosition(DcmDataset *dataset);
+
+  /// Fill min and max with the extremum values found in the image
+  static void getFrameMinMax(DicomImage *img, double *min, double *max);
+
+  static int getSeriesNumber(DcmDataset *dataset);
+  static int getInstanceNumber(DcmDataset *dataset);
+  static int getAcquisitionNumber(DcmDataset *dataset);
+
+private:
+  /// The header content extracted from one file by a load worker
+  struct LoadedFile {
+    /// False if the file could not be read
+    bool ok;
+    std::unique_ptr<DcmFileFormat> file;
+    offile_off_t pixel_data_offset;
+    std::string patient_name;
+    int instance_number;
+    int width;
+    int height;
+    /// [row_spacing, col_spacing] in mm
+    std::vector<double> pixel_spacing;
+  };
+
+  /// Parse the header of the file at 'path' and extract the elements checked
+  /// by loadHeaders, can be run from a worker thread
+  static LoadedFile readDicomFile(const std::string &path);
+
+  /// Read the elements of the file at 'path' from 'pixel_data_offset' and
+  /// return a copy of the elements of 'header' completed with its Pixel
+  /// Data. Return nullptr if the pixel data can't be read this way.
+  static std::unique_ptr<DcmDataset>
+  readPixelData(const std::string &path, DcmFileFormat *header,
+                offile_off_t pixel_data_offset);
+
+  /// Fill 'values' with the modality values of the first frame of 'img'
+  /// return false if the image does not provide monochrome pixel data
+  static bool getModalityValues(DicomImage *img,
+                                std::vector<int16_t> *values);
+};
+
+template <typename T>
+T getField(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos = 0);
+template <typename T>
+T getField(DcmItem *item, unsigned int g, unsigned int e,
+           unsigned long pos = 0) {
+  return getField<T>(item, DcmTagKey(g, e), pos);
+}
+
+template <>
+double getField<double>(DcmItem *item, const DcmTagKey &tag_key,
+                        unsigned long pos);
+template <>
+short int getField<short int>(DcmItem *item, const DcmTagKey &tag_key,
+                              unsigned long pos);
+template <>
+unsigned short getField<unsigned short>(DcmItem *item,
+                                        const DcmTagKey &tag_key,
+                                        unsigned long pos);
+template <>
+int getField<int>(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos);
+template <>
+std::string getField<std::string>(DcmItem *item, const DcmTagKey &tag_key,
+                                  unsigned long pos);
+
+template <typename T>
+std::vector<T> getFieldVector(DcmItem *item, const DcmTagKey &tag_key,
+                              int fixed_size) {
+  std::vector<T> result(fixed_size);
+  for (int i = 0; i < fixed_size; i++) {
+    result[i] = getField<T>(item, tag_key, i);
+  }
+  return result;
+}
+
+#endif // DICOM_COLLECTION_H
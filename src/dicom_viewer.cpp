@@ -1,5 +1,6 @@
 #include "dicom_viewer.h"
 
+#include <algorithm>
 #include <iostream>
 #include <set>
 #include <cmath>
@@ -7,13 +8,36 @@
 #include <QFileDialog>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QStatusBar>
 
 #include <dcmtk/dcmdata/dcrledrg.h>
 #include <dcmtk/dcmjpeg/djdecode.h>
 
+#include "thread_pool.h"
+#include "window_level.h"
+
+/// Maximal number of pixels along each side of the oblique image
+static const int max_oblique_size = 1024;
+
+/// Minimal delay between two refreshes of the views while streaming [ms]
+static const int stream_refresh_delay = 100;
+
+/// Wrap 'layer' of 'volume' in a read-only QImage without copying it, the
+/// image is only valid while the volume is alive
+static QImage wrapLayer(const VolumicData &volume, int layer) {
+  return QImage(volume.getLayer(layer), volume.width, volume.height,
+                volume.width, QImage::Format_Grayscale8);
+}
+
 DicomViewer::DicomViewer(QWidget *parent)
-    : QMainWindow(parent), image(nullptr), img_data(nullptr), pixel_width(-1),
-      pixel_height(-1), slice_spacing(0),
+    : QMainWindow(parent), volume_from_cache(false),
+      volume_cache(VolumeCache::getDefaultDirectory()),
+      streamed_first_layer(0), streamed_last_layer(-1),
+      default_window_center(0), default_window_width(1),
+      min_instance(std::numeric_limits<int>::max()),
+      max_instance(std::numeric_limits<int>::lowest()), preview_factor(1),
+      oblique_offset(0),
+      pixel_width(-1), pixel_height(-1), slice_spacing(0),
       collection_min(std::numeric_limits<double>::max()),
       collection_max(std::numeric_limits<double>::lowest()) {
   // Setting layout
@@ -21,9 +45,19 @@ DicomViewer::DicomViewer(QWidget *parent)
   setCentralWidget(widget);
   img_label = new ImageLabel();
   img_label->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  coronal_label = new ImageLabel();
+  coronal_label->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  sagittal_label = new ImageLabel();
+  sagittal_label->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  oblique_label = new ObliqueLabel();
+  oblique_label->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  oblique_label->setToolTip(
+      "Drag to rotate the plane, use the wheel to move it");
   layout = new QGridLayout();
   slice_slider = new IntSlider("Slice", 0, 0);
   current_layer = slice_slider->value();
+  coronal_slider = new IntSlider("Coronal plane", 0, 0);
+  sagittal_slider = new IntSlider("Sagittal plane", 0, 0);
   k_slider = new IntSlider("Manual segmentation parameter (k)", 1, 6);
   alpha_slider = new DoubleSlider("Alpha", 0.0, 1.0);
   window_center_slider = new DoubleSlider("Window center", -1000.0, 1000.0);
@@ -41,6 +75,7 @@ DicomViewer::DicomViewer(QWidget *parent)
   proj_view = new QComboBox();
   proj_view->addItem("Ortho Projection");
   proj_view->addItem("Frustum Projection");
+  proj_view->addItem("Ray Marching");
 
   layout->addWidget(alpha_slider, 0, 0, 1, 3);
   layout->addWidget(slice_slider, 1, 0, 1, 3);
@@ -57,8 +92,24 @@ DicomViewer::DicomViewer(QWidget *parent)
   layout->addWidget(use_16_bits, 12, 0);
   layout->addWidget(img_label, 5, 1, 8, 1);
   layout->addWidget(gl_widget, 5, 2, 8, 1);
+  layout->addWidget(coronal_slider, 13, 1);
+  layout->addWidget(sagittal_slider, 13, 2);
+  layout->addWidget(coronal_label, 14, 1);
+  layout->addWidget(sagittal_label, 14, 2);
+  layout->addWidget(oblique_label, 14, 0);
   widget->setLayout(layout);
   setCheckBoxes(false);
+  // Progress of the decoding
+  load_progress = new QProgressBar();
+  load_progress->setFormat("Decoding slices: %v/%m");
+  cancel_load_button = new QPushButton("Cancel");
+  statusBar()->addPermanentWidget(load_progress);
+  statusBar()->addPermanentWidget(cancel_load_button);
+  load_progress->setVisible(false);
+  cancel_load_button->setVisible(false);
+  stream_refresh_timer = new QTimer(this);
+  stream_refresh_timer->setSingleShot(true);
+  stream_refresh_timer->setInterval(stream_refresh_delay);
   // Setting menu
   QMenu *file_menu = menuBar()->addMenu("&File");
   QAction *open_collection_action = file_menu->addAction("&Open collection");
@@ -68,6 +119,11 @@ DicomViewer::DicomViewer(QWidget *parent)
   QAction *save_action = file_menu->addAction("&Save");
   save_action->setShortcut(QKeySequence::Save);
   QObject::connect(save_action, SIGNAL(triggered()), this, SLOT(save()));
+  QAction *export_action = file_menu->addAction("&Export 3D view");
+  QObject::connect(export_action, SIGNAL(triggered()), this,
+                   SLOT(exportVolumeView()));
+  compress_action = file_menu->addAction("&Compress volumes");
+  compress_action->setCheckable(true);
   QAction *help_action = file_menu->addAction("&Help");
   help_action->setShortcut(QKeySequence::HelpContents);
   QObject::connect(help_action, SIGNAL(triggered()), this, SLOT(showStats()));
@@ -81,6 +137,14 @@ DicomViewer::DicomViewer(QWidget *parent)
           SLOT(setProj(int)));
   connect(slice_slider, SIGNAL(valueChanged(int)), this,
           SLOT(onSliceChange(int)));
+  connect(coronal_slider, SIGNAL(valueChanged(int)), this,
+          SLOT(onCoronalPlaneChange(int)));
+  connect(sagittal_slider, SIGNAL(valueChanged(int)), this,
+          SLOT(onSagittalPlaneChange(int)));
+  connect(oblique_label, SIGNAL(rotationRequested(int, int)), this,
+          SLOT(onObliqueRotation(int, int)));
+  connect(oblique_label, SIGNAL(translationRequested(int)), this,
+          SLOT(onObliqueTranslation(int)));
   connect(window_center_slider, SIGNAL(valueChanged(double)), this,
           SLOT(onWindowCenterChange(double)));
   connect(window_width_slider, SIGNAL(valueChanged(double)), this,
@@ -102,13 +166,20 @@ DicomViewer::DicomViewer(QWidget *parent)
   connect(use_16_bits, SIGNAL(toggled(bool)), this,
           SLOT(onCheckBitsChange(bool)));
 
+  // Streaming connection
+  connect(&decoder, SIGNAL(slicesDecoded()), this, SLOT(onSlicesDecoded()));
+  connect(&decoder, SIGNAL(finished()), this, SLOT(onDecodingFinished()));
+  connect(cancel_load_button, SIGNAL(clicked()), this, SLOT(cancelLoad()));
+  connect(stream_refresh_timer, SIGNAL(timeout()), this,
+          SLOT(refreshStreamedLayers()));
+
   // Codec registration
   DcmRLEDecoderRegistration::registerCodecs();
   //DJDecoderRegistration::registerCodecs();
 
   // Update basic display elements
-  updateInstanceLimits();
   updateSliceSlider();
+  updatePlaneSliders();
   updateWindowSliders();
   // Importing alpha value from gl_widget
   alpha_slider->setValue(gl_widget->getAlpha());
@@ -116,156 +187,262 @@ DicomViewer::DicomViewer(QWidget *parent)
   k_slider->setVisible(false);
 }
 
-DicomViewer::~DicomViewer() {}
-
 void DicomViewer::openDicomCollection() {
   QStringList files = QFileDialog::getOpenFileNames(
       this, "Select files to open", "DICOM (*.dcm)");
   // If no file has been selected, don't change anything
   if (files.size() == 0)
     return;
-  // TODO: this code section clearly exhibits that it would be way better to
-  // encapsulate the DicomCollection in a class with several attributes, to load
-  // it and then to have a collection = std::move(new_collection)
-
-  // First reading all the collection properties in temporary variables to
-  // avoid modification of the current data if provided files are invalid
-  std::map<int, std::unique_ptr<DcmFileFormat>> new_files;
-  std::string new_patient;
-  double new_collection_min = std::numeric_limits<double>::max();
-  double new_collection_max = std::numeric_limits<double>::lowest();
-  double new_pixel_width(-1);
-  double new_pixel_height(-1);
-  for (int file_idx = 0; file_idx < files.size(); file_idx++) {
-    const QString &file = files[file_idx];
-    std::string path = file.toStdString();
-    std::unique_ptr<DcmFileFormat> dcm_file(new DcmFileFormat());
-    OFCondition status;
-    status = dcm_file->loadFile(path.c_str());
-    if (status.bad()) {
-      QMessageBox::critical(this, "Failed to open file", path.c_str());
-      return;
-    }
-    DcmDataset *file_ds = dcm_file->getDataset();
-    // Checking patient
-    std::string file_patient = getPatientName(file_ds);
-    if (new_patient == "") {
-      new_patient = file_patient;
-    } else if (new_patient != file_patient) {
-      std::string msg =
-          "At least 2 patients are present in the file collection: '" +
-          new_patient + "' and '" + file_patient + "'";
-      QMessageBox::critical(this, "Invalid file collection", msg.c_str());
-      return;
-    }
-
-    int instance_number = getInstanceNumber(file_ds);
-    // Checking that instance number is not duplicated
-    if (new_files.count(instance_number) > 0) {
-      std::string msg = "Instance " + std::to_string(instance_number) +
-                        " is already loaded, cancelling load";
-      QMessageBox::critical(this, "Duplicated instance idx", msg.c_str());
-      return;
-    }
-    // All the Dicom file should contain loadable images
-    DicomImage *img = loadDicomImage(file_ds);
-    if (img == nullptr) {
-      QMessageBox::critical(this, "Invalid file",
-                            ("Can't read image at file " + path).c_str());
-      return;
-    }
-    // Updating min and max of collection
-    double frame_min, frame_max;
-    getFrameMinMax(img, &frame_min, &frame_max);
-    new_collection_min = std::min(frame_min, new_collection_min);
-    new_collection_max = std::max(frame_max, new_collection_max);
-    new_files[instance_number] = std::move(dcm_file);
-    // Updating/checking pixel_width
-    std::vector<double> pixel_spacing = getPixelSpacing(file_ds);
-    double frame_pixel_height = pixel_spacing[0];
-    double frame_pixel_width = pixel_spacing[1];
-    if (file_idx == 0) {
-      new_pixel_width = frame_pixel_width;
-      new_pixel_height = frame_pixel_height;
-    } else if (new_pixel_width != frame_pixel_width ||
-               new_pixel_height != frame_pixel_height) {
-      std::ostringstream msg_oss;
-      msg_oss << "Multiple pixel sizes found: " << new_pixel_width << "*"
-              << new_pixel_height << " and " << frame_pixel_width << "*"
-              << frame_pixel_height;
-      QMessageBox::critical(this, "Inconsistent collection",
-                            msg_oss.str().c_str());
-      return;
-    }
+  // Reading the collection in a separate object to avoid modification of the
+  // current data if provided files are invalid
+  std::vector<std::string> paths;
+  for (const QString &file : files) {
+    paths.push_back(file.toStdString());
   }
-  // Check slice_spacing consistency
-  double new_slice_offset(0);
-  double new_slice_spacing(-1);
-  if (new_files.size() <= 1) {
-    new_slice_spacing = 0;
-  } else {
-    int new_min_instance = new_files.begin()->first;
-    int new_max_instance = new_files.rbegin()->first;
-    // Deducing layer spacing and offset from extremum layers
-    std::vector<double> first_layer_position =
-        getImagePosition(new_files.begin()->second->getDataset());
-    std::vector<double> last_layer_position =
-        getImagePosition(new_files.rbegin()->second->getDataset());
-    new_slice_spacing = (last_layer_position[2] - first_layer_position[2]) /
-                        (new_max_instance - new_min_instance);
-    new_slice_offset =
-        first_layer_position[2] - new_min_instance * new_slice_spacing;
-    // Checking that all layers roughly respect the provided their expected
-    // position
-    double max_tol = 0.01; //[mm]
-    for (const auto &entry : new_files) {
-      double expected_z = new_slice_spacing * entry.first + new_slice_offset;
-      double received_z = getImagePosition(entry.second->getDataset())[2];
-      double error_z = fabs(expected_z - received_z);
-      if (error_z > max_tol) {
-        std::string msg = "Slices are not regularly spaced, error: " +
-                          std::to_string(error_z);
-        QMessageBox::critical(this, "Inconsistent collection", msg.c_str());
-        return;
-      }
-    }
+  DicomCollection collection;
+  collection.compress_volume = compress_action->isChecked();
+  // Collections opened before are mapped from the cache without being
+  // parsed, unless they are to be packed
+  bool from_cache =
+      !collection.compress_volume && volume_cache.load(paths, &collection);
+  std::string error_title, error_msg;
+  if (!from_cache &&
+      !collection.loadHeaders(paths, &error_title, &error_msg)) {
+    QMessageBox::critical(this, error_title.c_str(), error_msg.c_str());
+    return;
   }
 
-  // Replacing current elements
+  // Replacing current elements, a collection being decoded is dropped
+  decoder.cancel();
+  decoded_collection = DicomCollection();
+  stream_refresh_timer->stop();
   active_files.clear();
-  for (auto &entry : new_files) {
-    active_files[entry.first] = std::move(entry.second);
+  staged_slices = CollectionDecoder::Batch();
+  file_paths = collection.file_paths;
+  volume_from_cache = from_cache;
+  paged_volume = collection.paged_volume;
+  if (paged_volume) {
+    // The 3D view and the oblique plane show a preview of the volume, at
+    // half resolution at least for packed volumes to keep their gain
+    preview_factor =
+        paged_volume->getPreviewFactor(collection.memory_budget / 8);
+    if (paged_volume->getStorage() == PagedVolume::PACKED)
+      preview_factor = std::max(preview_factor, 2);
+    raw_volume = paged_volume->createPreview(preview_factor);
+  } else {
+    preview_factor = 1;
+    raw_volume = collection.volume;
   }
-  patient_name = new_patient;
-  collection_min = new_collection_min;
-  collection_max = new_collection_max;
-  pixel_height = new_pixel_height;
-  pixel_width = new_pixel_width;
-  slice_spacing = new_slice_spacing;
+  windowed_volume.reset();
+  patient_name = collection.patient_name;
+  // The extremum values are known once slices are decoded
+  collection_min = collection.min_value;
+  collection_max = collection.max_value;
+  pixel_height = collection.pixel_height;
+  pixel_width = collection.pixel_width;
+  slice_spacing = collection.slice_spacing;
+  min_instance = collection.min_instance;
+  max_instance = collection.max_instance;
+  default_window_center = collection.window_center;
+  default_window_width = collection.window_width;
 
   // Updating all the internal members based on the new data
-  updateInstanceLimits();
-  int expected_instances = max_instance - min_instance + 1;
-  if (active_files.size() != (size_t)expected_instances) {
+  int expected_instances = collection.getExpectedInstances();
+  if (collection.file_paths.size() != (size_t)expected_instances) {
     std::string msg = "Expecting " + std::to_string(expected_instances) +
                       " instances, received " +
-                      std::to_string(active_files.size()) + " instances";
+                      std::to_string(collection.file_paths.size()) +
+                      " instances";
     QMessageBox::warning(this, "Missing instances", msg.c_str());
   }
+  resetPlaneCaches();
   updateSliceSlider();
-  loadDicomImage();
+  updatePlaneSliders();
   updateWindowSliders();
   applyDefaultWindow();
   updateImage();
+  updateReformattedImages();
+  resetObliquePlane();
+  updateObliqueImage();
   updateVolumicData();
   updateRawData();
   setCheckBoxes(true);
+  if (from_cache) {
+    load_progress->setVisible(false);
+    cancel_load_button->setVisible(false);
+    return;
+  }
+
+  // The pixel data is decoded in the background, the slices appear as they
+  // are decoded
+  streamed_first_layer = 0;
+  streamed_last_layer = -1;
+  load_progress->setRange(0, (int)collection.files.size());
+  load_progress->setValue(0);
+  load_progress->setVisible(true);
+  cancel_load_button->setVisible(true);
+  decoder.start(&collection);
+  decoded_collection = std::move(collection);
+}
+
+void DicomViewer::onSlicesDecoded() {
+  CollectionDecoder::Batch batch = decoder.takeBatch();
+  if (!raw_volume)
+    return;
+  bool first_slices = active_files.empty() && staged_slices.slices.empty();
+  double old_min = collection_min;
+  double old_max = collection_max;
+  std::string error_title, error_msg;
+  for (auto &entry : batch.slices) {
+    int instance = entry.first;
+    DicomCollection::DecodedSlice &slice = entry.second;
+    if (!slice.ok) {
+      if (error_title.empty()) {
+        error_title = slice.error_title;
+        error_msg = slice.error_msg;
+      }
+      continue;
+    }
+    int layer = instance - min_instance;
+    collection_min = std::min(collection_min, slice.min_value);
+    collection_max = std::max(collection_max, slice.max_value);
+    if (streamed_first_layer > streamed_last_layer) {
+      streamed_first_layer = layer;
+      streamed_last_layer = layer;
+    } else {
+      streamed_first_layer = std::min(streamed_first_layer, layer);
+      streamed_last_layer = std::max(streamed_last_layer, layer);
+    }
+    // Jobs are reading the volume in the background, the layer is written
+    // by the next refresh
+    staged_slices.files[instance] = std::move(batch.files[instance]);
+    staged_slices.slices[instance] = std::move(slice);
+  }
+  load_progress->setValue(decoder.getNbDecoded());
+  if (collection_min != old_min || collection_max != old_max)
+    updateWindowSliders();
+  // The window sliders were hidden until now
+  if (first_slices && !staged_slices.slices.empty())
+    applyDefaultWindow();
+  if (!error_title.empty()) {
+    // As in DicomCollection::load, a slice which cannot be decoded rejects
+    // the collection: decoding stops and the volume is not cached. The
+    // slices which are missing are shown as unavailable.
+    cancelLoad();
+    QMessageBox::critical(this, error_title.c_str(), error_msg.c_str());
+    return;
+  }
+  if (!stream_refresh_timer->isActive())
+    stream_refresh_timer->start();
+}
+
+void DicomViewer::onDecodingFinished() {
+  load_progress->setVisible(false);
+  cancel_load_button->setVisible(false);
+  stream_refresh_timer->stop();
+  refreshStreamedLayers();
+  decoded_collection.releaseUnpackedBricks();
+  if (paged_volume && paged_volume->hasWriteError())
+    QMessageBox::warning(this, "Failed to write bricks",
+                         "Some bricks could not be written to disk, they "
+                         "are kept in memory beyond the budget");
+  // Decoding stops on the first error, all the slices are decoded here
+  saveToCache();
+}
+
+void DicomViewer::cancelLoad() {
+  decoder.cancel();
+  load_progress->setVisible(false);
+  cancel_load_button->setVisible(false);
+  stream_refresh_timer->stop();
+  refreshStreamedLayers();
+  decoded_collection.releaseUnpackedBricks();
+  decoded_collection = DicomCollection();
+}
+
+void DicomViewer::saveToCache() {
+  // The extremum values are only known once all slices are decoded
+  decoded_collection.min_value = collection_min;
+  decoded_collection.max_value = collection_max;
+  std::shared_ptr<const DicomCollection> collection =
+      std::make_shared<DicomCollection>(std::move(decoded_collection));
+  decoded_collection = DicomCollection();
+  // The volume is not modified anymore, it is written while being displayed
+  VolumeCache cache = volume_cache;
+  ThreadPool::getInstance().submit(
+      [cache, collection]() { cache.save(*collection); });
+}
+
+void DicomViewer::refreshStreamedLayers() {
+  if (!raw_volume || streamed_first_layer > streamed_last_layer)
+    return;
+  // The jobs and the prefetch tasks read the volume without lock, they are
+  // stopped while the layers are written and started again by the updates
+  // below
+  volume_job.cancel();
+  volume_job.wait();
+  gl_widget->stopRawDataJobs();
+  slice_cache.cancelPrefetch();
+  for (auto &entry : staged_slices.slices) {
+    int layer = entry.first - min_instance;
+    if (paged_volume)
+      paged_volume->setLayer(entry.second.values.data(), layer);
+    else
+      raw_volume->setLayer(entry.second.values.data(), layer);
+    active_files[entry.first] = std::move(staged_slices.files[entry.first]);
+  }
+  staged_slices = CollectionDecoder::Batch();
+  // The caches hold images of the empty layers
+  resetPlaneCaches();
+  int first_layer = streamed_first_layer;
+  int last_layer = streamed_last_layer;
+  if (paged_volume) {
+    // The layers of the preview covering the new layers are averaged again
+    first_layer /= preview_factor;
+    last_layer /= preview_factor;
+    paged_volume->downsampleLayers(preview_factor, first_layer, last_layer,
+                                   raw_volume.get());
+  }
+  gl_widget->updateRawDataLayers(first_layer, last_layer);
+  streamed_first_layer = 0;
+  streamed_last_layer = -1;
+  updateImage();
+  updateReformattedImages();
+  updateObliqueImage();
+  updateVolumicData();
+  gl_widget->update();
+}
+
+void DicomViewer::resetPlaneCaches() {
+  // The 2D views of paged collections keep the full resolution
+  if (paged_volume) {
+    plane_extractor.setVolume(std::shared_ptr<const PagedVolume>(paged_volume));
+    slice_cache.setVolume(std::shared_ptr<const PagedVolume>(paged_volume));
+  } else {
+    plane_extractor.setVolume(raw_volume);
+    slice_cache.setVolume(raw_volume);
+  }
 }
 
 void DicomViewer::save() {
   QString fileName = QFileDialog::getSaveFileName(
       this, tr("Save image to: "), "tmp.png", tr("Images (*.png *.xpm *.jpg)"));
-  if (!getQImage().save(fileName))
+  std::shared_ptr<const VolumicData> wrapped_volume;
+  if (!getQImage(&wrapped_volume).save(fileName))
+    QMessageBox::critical(this, "Failed to save file", fileName);
+}
+
+void DicomViewer::exportVolumeView() {
+  // The view is ray cast on the CPU, using the size of the 3D widget
+  QImage view = gl_widget->renderSoftware(gl_widget->size());
+  if (view.isNull()) {
+    QMessageBox::critical(this, "Failed to export view",
+                          "No volume available");
+    return;
+  }
+  QString fileName = QFileDialog::getSaveFileName(
+      this, tr("Save 3D view to: "), "view.png", tr("Images (*.png *.jpg)"));
+  if (!view.save(fileName))
     QMessageBox::critical(this, "Failed to save file", fileName);
 }
 
@@ -274,32 +451,52 @@ void DicomViewer::showStats() {
   std::ostringstream msg_oss;
   msg_oss << "<h1>Collection Properties</h1>";
   msg_oss << "Patient: " << patient_name << html_endl;
-  msg_oss << "Nb loaded slices: " << active_files.size() << html_endl;
+  msg_oss << "Nb loaded slices: "
+          << (volume_from_cache ? file_paths.size() : active_files.size())
+          << html_endl;
   msg_oss << "Values used: [" << collection_min << "," << collection_max << "]"
           << html_endl;
   msg_oss << "Pixel size: " << pixel_width << "*" << pixel_height << " [mm]"
           << html_endl;
   msg_oss << "Slices spacing: " << slice_spacing << " [mm]" << html_endl;
+  if (paged_volume && paged_volume->getStorage() == PagedVolume::PACKED) {
+    msg_oss << "Packed volume: " << (paged_volume->getPackedSize() >> 20)
+            << " MiB, " << (paged_volume->getMemoryUsage() >> 20)
+            << " MiB unpacked" << html_endl;
+  } else if (paged_volume) {
+    msg_oss << "Paged volume: " << (paged_volume->getMemoryUsage() >> 20)
+            << " MiB in memory, budget "
+            << (paged_volume->getMemoryBudget() >> 20) << " MiB" << html_endl;
+    if (paged_volume->hasWriteError())
+      msg_oss << "Failed to write bricks to disk, budget exceeded"
+              << html_endl;
+  }
+  if (paged_volume)
+    msg_oss << "3D view downsampled by " << preview_factor << html_endl;
   msg_oss << html_endl;
   msg_oss << "<h1>Frame Properties</h1>";
   DcmDataset *ds = getDataset();
   if (ds != nullptr) {
-    msg_oss << "Instance number: " << getInstanceNumber(ds) << html_endl;
-    msg_oss << "Acquisition number: " << getAcquisitionNumber(ds) << html_endl;
+    msg_oss << "Instance number: " << DicomCollection::getInstanceNumber(ds) << html_endl;
+    msg_oss << "Acquisition number: " << DicomCollection::getAcquisitionNumber(ds) << html_endl;
     E_TransferSyntax original_syntax = ds->getOriginalXfer();
     DcmXfer xfer(original_syntax);
     msg_oss << "Original transfer syntax: (" << original_syntax << ") "
             << xfer.getXferName() << html_endl;
 
-    std::vector<double> img_position = getImagePosition(ds);
+    std::vector<double> img_position = DicomCollection::getImagePosition(ds);
     msg_oss << "Image position: [" << img_position[0] << "," << img_position[1]
             << "," << img_position[2] << "]" << html_endl;
 
-    DicomImage *image = getDicomImage();
-    if (image) {
-      msg_oss << "Nb frames: " << image->getFrameCount() << html_endl;
-      msg_oss << "Size: " << image->getWidth() << "*" << image->getHeight()
-              << "*" << image->getDepth() << html_endl;
+    // The pixel data was released, values come from the volume
+    if (raw_volume) {
+      Sint32 nb_frames = 1;
+      ds->findAndGetSint32(DCM_NumberOfFrames, nb_frames);
+      msg_oss << "Nb frames: " << nb_frames << html_endl;
+      int width, height;
+      plane_extractor.getPlaneSize(PlaneExtractor::AXIAL, &width, &height);
+      msg_oss << "Size: " << width << "*" << height << "*"
+              << getField<unsigned short>(ds, DCM_BitsStored) << html_endl;
       double min_used_value, max_used_value, min_allowed_value,
           max_allowed_value;
       getMinMax(&min_used_value, &max_used_value, &min_allowed_value,
@@ -324,47 +521,83 @@ void DicomViewer::showStats() {
 void DicomViewer::onSliceChange(int new_slice) {
   (void)new_slice;
   current_layer = slice_slider->value();
-  gl_widget->setCurrentSlice(current_layer);
+  gl_widget->setCurrentSlice((current_layer - min_instance) / preview_factor);
   if(gl_widget->getHighlight() || gl_widget->getHideBelow() || gl_widget->getHideAbove() )
     gl_widget->update();
-  loadDicomImage();
   updateImage();
 }
 
+void DicomViewer::onCoronalPlaneChange(int new_plane) {
+  (void)new_plane;
+  updateReformattedImage(PlaneExtractor::CORONAL);
+}
+
+void DicomViewer::onSagittalPlaneChange(int new_plane) {
+  (void)new_plane;
+  updateReformattedImage(PlaneExtractor::SAGITTAL);
+}
+
+void DicomViewer::onObliqueRotation(int dx, int dy) {
+  // Rotating around the axes of the image, as the 3D view does
+  QQuaternion local_rotation =
+      QQuaternion::fromEulerAngles(0.5 * dy, 0.5 * dx, 0);
+  oblique_orientation = (oblique_orientation * local_rotation).normalized();
+  // The extent of the volume along the new normal may be shorter
+  clampObliqueOffset();
+  updateObliqueImage();
+}
+
+void DicomViewer::onObliqueTranslation(int steps) {
+  if (!raw_volume)
+    return;
+  oblique_offset += steps * getObliqueSpacing();
+  clampObliqueOffset();
+  updateObliqueImage();
+}
+
 void DicomViewer::onWindowCenterChange(double new_window_center) {
   (void)new_window_center;
   updateImage();
-  if(use_16_bits->isChecked())
-    updateRawData();
-  else
+  updateReformattedImages();
+  updateObliqueImage();
+  // The window of the raw data is also used by the ray marching
+  updateRawData();
+  if(!use_16_bits->isChecked())
     updateVolumicData();
 }
 
 void DicomViewer::onWindowWidthChange(double new_window_width) {
   (void)new_window_width;
   updateImage();
-  if(use_16_bits->isChecked())
-    updateRawData();
-  else
+  updateReformattedImages();
+  updateObliqueImage();
+  // The window of the raw data is also used by the ray marching
+  updateRawData();
+  if(!use_16_bits->isChecked())
     updateVolumicData();
 }
 
 DcmDataset *DicomViewer::getDataset() {
   int idx = slice_slider->value();
+  // Volumes opened from the cache come without headers, they are parsed the
+  // first time they are needed
+  if (active_files.count(idx) == 0 && volume_from_cache &&
+      file_paths.count(idx) > 0) {
+    std::unique_ptr<DcmFileFormat> file =
+        DicomCollection::readHeader(file_paths.at(idx));
+    if (file)
+      active_files[idx] = std::move(file);
+  }
   if (active_files.count(idx) == 0)
     return nullptr;
   return active_files.at(idx)->getDataset();
 }
 
-void DicomViewer::updateInstanceLimits() {
-  min_instance = std::numeric_limits<int>::max();
-  max_instance = std::numeric_limits<int>::lowest();
-  for (const auto &entry : active_files) {
-    if (entry.first < min_instance)
-      min_instance = entry.first;
-    if (entry.first > max_instance)
-      max_instance = entry.first;
-  }
+bool DicomViewer::isSliceAvailable() {
+  int idx = slice_slider->value();
+  if (volume_from_cache)
+    return file_paths.count(idx) > 0;
+  return active_files.count(idx) > 0;
 }
 
 void DicomViewer::updateSliceSlider() {
@@ -372,8 +605,21 @@ void DicomViewer::updateSliceSlider() {
   slice_slider->setVisible(min_instance < max_instance);
 }
 
+void DicomViewer::updatePlaneSliders() {
+  for (PlaneExtractor::Axis axis :
+       {PlaneExtractor::CORONAL, PlaneExtractor::SAGITTAL}) {
+    IntSlider *slider =
+        axis == PlaneExtractor::CORONAL ? coronal_slider : sagittal_slider;
+    int nb_planes = plane_extractor.getNbPlanes(axis);
+    slider->setRange(0, std::max(nb_planes - 1, 0));
+    slider->setValue(nb_planes / 2);
+    slider->setVisible(nb_planes > 1);
+  }
+}
+
 void DicomViewer::updateWindowSliders() {
-  if (active_files.size() == 0) {
+  // The limits are only known once a slice is decoded
+  if (collection_min > collection_max) {
     window_center_slider->setVisible(false);
     window_width_slider->setVisible(false);
     return;
@@ -385,176 +631,254 @@ void DicomViewer::updateWindowSliders() {
   window_center_slider->setLimits(collection_min, collection_max);
   window_width_slider->setLimits(1.0, collection_max - collection_min);
 }
-void DicomViewer::loadDicomImage() {
-  if (image != nullptr)
-    delete (image);
-  image = loadDicomImage(getDataset());
+void DicomViewer::applyDefaultWindow() {
+  window_center_slider->setValue(default_window_center);
+  window_width_slider->setValue(default_window_width);
 }
 
-DicomImage *DicomViewer::loadDicomImage(DcmDataset *dataset) {
-  if (dataset == nullptr) {
-    return nullptr;
-  }
-  // Changing syntax to a common one
-  E_TransferSyntax wished_ts = EXS_LittleEndianExplicit;
-  OFCondition status = dataset->chooseRepresentation(wished_ts, NULL);
-  if (status.bad()) {
-    QMessageBox::critical(this, "Dicom Image failure", status.text());
-    return nullptr;
+void DicomViewer::updateImage() {
+  if (!raw_volume || !isSliceAvailable()) {
+    img_label->setText("No available image");
+    return;
   }
-  return new DicomImage(dataset, wished_ts);
+  std::shared_ptr<const VolumicData> wrapped_volume;
+  img_label->setImg(getQImage(&wrapped_volume));
+  // The volume previously shown is released once the label replaced its
+  // image
+  displayed_volume = std::move(wrapped_volume);
 }
 
-void DicomViewer::applyDefaultWindow() {
-  window_center_slider->setValue(getWindowCenter());
-  window_width_slider->setValue(getWindowWidth());
+void DicomViewer::updateReformattedImages() {
+  updateReformattedImage(PlaneExtractor::CORONAL);
+  updateReformattedImage(PlaneExtractor::SAGITTAL);
 }
 
-void DicomViewer::updateImage() {
-  if (image == nullptr) {
-    img_label->setText("No available image");
+void DicomViewer::updateReformattedImage(PlaneExtractor::Axis axis) {
+  ImageLabel *label =
+      axis == PlaneExtractor::CORONAL ? coronal_label : sagittal_label;
+  if (plane_extractor.getNbPlanes(axis) == 0) {
+    label->setText("No available image");
     return;
   }
-  // Set window
-  double window_center = window_center_slider->value();
-  double window_width = window_width_slider->value();
-  image->setWindow(window_center, window_width);
-  img_label->setImg(getQImage());
+  label->setImg(getReformattedImage(axis));
 }
 
-void DicomViewer::updateRawData(){
-  int buffer_size = image->getWidth() * image->getHeight();
-  uint16_t buffer[buffer_size];
-
-  double window_center = window_center_slider->value();
-  double window_width = window_width_slider->value();
+void DicomViewer::resetObliquePlane() {
+  oblique_orientation = QQuaternion();
+  oblique_offset = 0;
+}
 
-  std::unique_ptr<RawData> new_data(new RawData(
-      image->getWidth(), image->getHeight(), max_instance - min_instance + 1));
-  for (const auto &entry : active_files) {
-    DicomImage *dicom = loadDicomImage(entry.second->getDataset());
-    dicom->setNoVoiTransformation();
-    int bits_per_pixel = 16;
-    int layer = entry.first;
-    int status =
-        dicom->getOutputData((void *)buffer, sizeof(uint16_t)*buffer_size, bits_per_pixel);
-    delete (dicom);
-    if (!status) {
-      QMessageBox::critical(this, "Failed update raw data",
-                            "getOutputData failed");
-      break;
-    }
-    new_data->setLayer(buffer, layer - min_instance);
+void DicomViewer::updateObliqueImage() {
+  if (!raw_volume || raw_volume->empty()) {
+    oblique_label->setText("No available image");
+    return;
   }
-  double min, max, collec_min, collec_max;
-  getMinMax(&min, &max, &collec_min, &collec_max);
-  new_data->setWindow(window_center, window_width, collec_min, collec_max);
-  new_data->pixel_width = pixel_width;
-  new_data->pixel_height = pixel_height;
-  new_data->slice_spacing = slice_spacing;
-  gl_widget->updateRawData(std::move(new_data));
-
-  gl_widget->update();
+  oblique_label->setImg(getObliqueImage());
 }
 
-void DicomViewer::updateVolumicData() {
-  // Building a buffer to store each layer data
-  int buffer_size = image->getWidth() * image->getHeight();
-  unsigned char buffer[buffer_size];
-  // Getting default window used
+void DicomViewer::updateRawData() {
+  if (!raw_volume)
+    return;
   double window_center = window_center_slider->value();
   double window_width = window_width_slider->value();
-  // Building a VolumicData object with appropriate dimensions
-  std::unique_ptr<VolumicData> new_data(new VolumicData(
-      image->getWidth(), image->getHeight(), max_instance - min_instance + 1));
-  for (const auto &entry : active_files) {
-    DicomImage *dicom = loadDicomImage(entry.second->getDataset());
-    dicom->setWindow(window_center, window_width);
-    int bits_per_pixel = 8;
-    int layer = entry.first;
-    int status =
-        dicom->getOutputData((void *)buffer, buffer_size, bits_per_pixel);
-    delete (dicom);
-    if (!status) {
-      QMessageBox::critical(this, "Failed update volumic data",
-                            "getOutputData failed");
-      continue;
-    }
-    new_data->setLayer(buffer, layer - min_instance);
-  }
-  new_data->pixel_width = pixel_width;
-  new_data->pixel_height = pixel_height;
-  new_data->slice_spacing = slice_spacing;
-  gl_widget->updateVolumicData(std::move(new_data));
+  raw_volume->setWindow(window_center, window_width);
+  gl_widget->updateRawData(raw_volume);
 
   gl_widget->update();
 }
 
-std::string DicomViewer::getPatientName(DcmDataset *ds) {
-  return getField<std::string>(ds, DCM_PatientName);
-}
-
-DicomImage *DicomViewer::getDicomImage() { return image; }
-
-QImage DicomViewer::getQImage() {
-  DicomImage *dicom = getDicomImage();
-  int bits_per_pixel = 8;
-  unsigned long data_size = dicom->getOutputDataSize(bits_per_pixel);
-  if (img_data)
-    free(img_data);
-  img_data = new unsigned char[data_size];
-  int status =
-      dicom->getOutputData((void *)img_data, data_size, bits_per_pixel);
-  if (!status) {
-    QMessageBox::critical(this, "Fatal error",
-                          "Failed to get output data when getting QImage");
+void DicomViewer::updateVolumicData() {
+  if (!raw_volume)
+    return;
+  // The 16-bit encoding computes its attributes from raw_volume, the 8-bit
+  // volume is released and only built again for the 8-bit encoding
+  if (use_16_bits->isChecked()) {
+    volume_job.cancel();
+    windowed_volume.reset();
+    gl_widget->updateVolumicData(nullptr);
+    // The 2D view stops wrapping its layers, releasing it
+    updateImage();
+    return;
+  }
+  // Getting current window
+  double window_center = window_center_slider->value();
+  double window_width = window_width_slider->value();
+  // The volume is built in the background, the 3D view keeps showing the
+  // previous one meanwhile
+  std::shared_ptr<const RawData> volume = raw_volume;
+  std::shared_ptr<VolumicData> new_data = std::make_shared<VolumicData>();
+  new_data->pixel_width = volume->pixel_width;
+  new_data->pixel_height = volume->pixel_height;
+  new_data->slice_spacing = volume->slice_spacing;
+  new_data->window_center = window_center;
+  new_data->window_width = window_width;
+  volume_job.start(
+      [volume, new_data](const std::atomic<bool> &cancelled) {
+        // Allocating on the worker, filling the volume is not free either
+        new_data->resize(volume->width, volume->height, volume->depth);
+        return applyWindowToVolume(
+            volume->data(), volume->getLayerSize(), volume->depth,
+            new_data->window_center, new_data->window_width,
+            new_data->data(), nullptr, 1, &cancelled);
+      },
+      [this, new_data]() {
+        windowed_volume = new_data;
+        gl_widget->updateVolumicData(new_data);
+        gl_widget->update();
+        // The 2D view can now wrap the layers of the new volume
+        updateImage();
+      });
+}
+
+QImage DicomViewer::getQImage(
+    std::shared_ptr<const VolumicData> *wrapped_volume) {
+  wrapped_volume->reset();
+  if (!raw_volume)
     return QImage();
+  int layer = current_layer - min_instance;
+  if (!paged_volume && windowed_volume && layer >= 0 &&
+      layer < windowed_volume->depth &&
+      windowed_volume->window_center == window_center_slider->value() &&
+      windowed_volume->window_width == window_width_slider->value()) {
+    *wrapped_volume = windowed_volume;
+    return wrapLayer(*windowed_volume, layer);
   }
-  int width = dicom->getWidth();
-  int height = dicom->getHeight();
-
-  return QImage(img_data, width, height, QImage::Format_Grayscale8);
-}
-
-std::vector<double> DicomViewer::getPixelSpacing(DcmDataset *dataset) {
-  return getFieldVector<double>(dataset, DcmTagKey(0x28, 0x30), 2);
-}
-
-std::vector<double> DicomViewer::getImagePosition(DcmDataset *dataset) {
-  return getFieldVector<double>(dataset, DcmTagKey(0x20, 0x32), 3);
+  slice_cache.setWindow(window_center_slider->value(),
+                        window_width_slider->value());
+  return slice_cache.getImage(layer);
+}
+
+QImage DicomViewer::getReformattedImage(PlaneExtractor::Axis axis) {
+  IntSlider *slider =
+      axis == PlaneExtractor::CORONAL ? coronal_slider : sagittal_slider;
+  int width, height;
+  plane_extractor.getPlaneSize(axis, &width, &height);
+  const int16_t *plane = plane_extractor.getPlane(axis, slider->value());
+  QImage img(width, height, QImage::Format_Grayscale8);
+  for (int y = 0; y < height; y++) {
+    applyWindow(plane + (size_t)y * width, width,
+                window_center_slider->value(), window_width_slider->value(),
+                img.scanLine(y));
+  }
+  // Lines are layers, they are shown with their physical thickness
+  double pixel_size =
+      axis == PlaneExtractor::CORONAL ? pixel_width : pixel_height;
+  if (slice_spacing == 0 || pixel_size <= 0)
+    return img;
+  int physical_height =
+      std::max(1, (int)std::round(height * fabs(slice_spacing) / pixel_size));
+  return img.scaled(width, physical_height, Qt::IgnoreAspectRatio,
+                    Qt::SmoothTransformation);
+}
+
+double DicomViewer::getObliqueSpacing() {
+  // The finest resolution available in the volume
+  double spacing = std::min(raw_volume->pixel_width, raw_volume->pixel_height);
+  if (raw_volume->slice_spacing != 0)
+    spacing = std::min(spacing, fabs(raw_volume->slice_spacing));
+  return spacing > 0 ? spacing : 1;
+}
+
+void DicomViewer::clampObliqueOffset() {
+  if (!raw_volume)
+    return;
+  // Half of the extent of the volume along the normal, measured between the
+  // centers of the extreme voxels as the plane center is
+  QVector3D normal = oblique_orientation.rotatedVector(QVector3D(0, 0, 1));
+  const RawData &volume = *raw_volume;
+  double voxel_size[3] = {volume.pixel_width, volume.pixel_height,
+                          fabs(volume.slice_spacing)};
+  int dims[3] = {volume.width, volume.height, volume.depth};
+  double max_offset = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double size_mm = voxel_size[axis] > 0 ? voxel_size[axis] : 1;
+    max_offset +=
+        fabs(normal[axis]) * std::max(dims[axis] - 1, 0) * size_mm / 2;
+  }
+  oblique_offset = std::min(std::max(oblique_offset, -max_offset), max_offset);
+}
+
+ObliquePlane DicomViewer::getObliquePlane(double spacing) {
+  QVector3D u = oblique_orientation.rotatedVector(QVector3D(1, 0, 0));
+  QVector3D v = oblique_orientation.rotatedVector(QVector3D(0, 1, 0));
+  QVector3D normal = QVector3D::crossProduct(u, v);
+  const RawData &volume = *raw_volume;
+  double voxel_size[3] = {volume.pixel_width, volume.pixel_height,
+                          fabs(volume.slice_spacing)};
+  int dims[3] = {volume.width, volume.height, volume.depth};
+  ObliquePlane plane;
+  for (int axis = 0; axis < 3; axis++) {
+    double size_mm = voxel_size[axis] > 0 ? voxel_size[axis] : 1;
+    plane.center[axis] =
+        (dims[axis] - 1) / 2.0 * size_mm + oblique_offset * normal[axis];
+    plane.u[axis] = spacing * u[axis];
+    plane.v[axis] = spacing * v[axis];
+  }
+  return plane;
+}
+
+QImage DicomViewer::getObliqueImage() {
+  // The image covers the diagonal of the volume whatever the orientation
+  const RawData &volume = *raw_volume;
+  double extent[3] = {volume.width * volume.pixel_width,
+                      volume.height * volume.pixel_height,
+                      volume.depth * fabs(volume.slice_spacing)};
+  double diagonal = std::sqrt(extent[0] * extent[0] + extent[1] * extent[1] +
+                              extent[2] * extent[2]);
+  double spacing = getObliqueSpacing();
+  int size = (int)std::ceil(diagonal / spacing);
+  if (size > max_oblique_size) {
+    size = max_oblique_size;
+    spacing = diagonal / size;
+  }
+  size = std::max(size, 1);
+  std::vector<int16_t> values((size_t)size * size);
+  reslice(volume, getObliquePlane(spacing), size, size, values.data());
+  // Pixels outside of the volume are below any window and appear black
+  QImage img(size, size, QImage::Format_Grayscale8);
+  for (int y = 0; y < size; y++) {
+    applyWindow(values.data() + (size_t)y * size, size,
+                window_center_slider->value(), window_width_slider->value(),
+                img.scanLine(y));
+  }
+  return img;
 }
 
 void DicomViewer::getMinMax(double *min_used_value, double *max_used_value,
                             double *min_allowed_value,
                             double *max_allowed_value) {
-  getDicomImage()->getMinMaxValues(*min_used_value, *max_used_value, 0);
+  // The layer at full resolution, raw_volume may be a preview
+  int width, height;
+  plane_extractor.getPlaneSize(PlaneExtractor::AXIAL, &width, &height);
+  const int16_t *values = plane_extractor.getPlane(
+      PlaneExtractor::AXIAL, current_layer - min_instance);
+  auto used = std::minmax_element(values, values + (size_t)width * height);
+  *min_used_value = *used.first;
+  *max_used_value = *used.second;
   if (min_allowed_value != nullptr || max_allowed_value != nullptr) {
-    double tmp_min, tmp_max;
-    getDicomImage()->getMinMaxValues(tmp_min, tmp_max, 1);
+    // The range of the stored values, through the modality transform
+    DcmDataset *ds = getDataset();
+    int bits = getField<unsigned short>(ds, DCM_BitsStored);
+    bool is_signed = getField<unsigned short>(ds, DCM_PixelRepresentation) == 1;
+    double stored_min = is_signed ? -std::ldexp(1.0, bits - 1) : 0;
+    double stored_max = std::ldexp(1.0, is_signed ? bits - 1 : bits) - 1;
+    Float64 slope = 1, intercept = 0;
+    ds->findAndGetFloat64(DCM_RescaleSlope, slope);
+    ds->findAndGetFloat64(DCM_RescaleIntercept, intercept);
+    double tmp_min = stored_min * slope + intercept;
+    double tmp_max = stored_max * slope + intercept;
     if (min_allowed_value)
-      *min_allowed_value = tmp_min;
+      *min_allowed_value = std::min(tmp_min, tmp_max);
     if (max_allowed_value)
-      *max_allowed_value = tmp_max;
+      *max_allowed_value = std::max(tmp_min, tmp_max);
   }
 }
 
-void DicomViewer::getFrameMinMax(DicomImage *img, double *min, double *max) {
-  int used_values_mode = 0;
-  img->getMinMaxValues(*min, *max, used_values_mode);
-}
-
 void DicomViewer::getCollectionMinMax(double *min, double *max) {
   *min = collection_min;
   *max = collection_max;
 }
 
-void DicomViewer::getWindow(double *min_value, double *max_value) {
-  double center(0), width(0);
-  getDicomImage()->getWindow(center, width);
-  *min_value = center - width / 2;
-  *max_value = center + width / 2;
-}
-
 double DicomViewer::getSlope() {
   return getField<double>(getDataset(), DcmTagKey(0x28, 0x1053));
 }
@@ -578,16 +902,6 @@ double DicomViewer::getWindowMax() {
   return getWindowCenter() + getWindowWidth() / 2;
 }
 
-int DicomViewer::getSeriesNumber(DcmDataset *dataset) {
-  return getField<int>(dataset, 0x20, 0x11);
-}
-int DicomViewer::getInstanceNumber(DcmDataset *dataset) {
-  return getField<int>(dataset, 0x20, 0x13);
-}
-int DicomViewer::getAcquisitionNumber(DcmDataset *dataset) {
-  return getField<int>(dataset, 0x20, 0x12);
-}
-
 void DicomViewer::onCheckHide2dChange(bool check) {
   (void)check;
 }
@@ -617,7 +931,16 @@ void DicomViewer::onCheckHideBelowChange(bool check) {
 }
 
 void DicomViewer::onCheckBitsChange(bool check) {
-  gl_widget->setBitEncode(check);
+  // The volume of the new encoding might use an outdated window, it is
+  // refreshed while the widget uses the 8-bit encoding which is cheaper
+  if (check) {
+    updateRawData();
+    gl_widget->setBitEncode(check);
+    updateVolumicData();
+  } else {
+    gl_widget->setBitEncode(check);
+    updateVolumicData();
+  }
   if(check)
     k_slider->setVisible(true);
   else
@@ -635,47 +958,3 @@ void DicomViewer::setCheckBoxes(bool check) {
   use_16_bits->setVisible(check);
   proj_view->setVisible(check);
 }
-
-/*///////////////
-/// TEMPLATES ///
-///////////////*/
-
-template <>
-double getField<double>(DcmItem *item, const DcmTagKey &tag_key,
-                        unsigned long pos) {
-  double value;
-  OFCondition status = item->findAndGetFloat64(tag_key, value, pos);
-  if (status.bad())
-    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
-              << std::endl;
-  return value;
-}
-template <>
-short int getField<short int>(DcmItem *item, const DcmTagKey &tag_key,
-                              unsigned long pos) {
-  short int value;
-  OFCondition status = item->findAndGetSint16(tag_key, value, pos);
-  if (status.bad())
-    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
-              << std::endl;
-  return value;
-}
-template <>
-int getField<int>(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos) {
-  int value;
-  OFCondition status = item->findAndGetSint32(tag_key, value, pos);
-  if (status.bad())
-    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
-              << std::endl;
-  return value;
-}
-template <>
-std::string getField<std::string>(DcmItem *item, const DcmTagKey &tag_key,
-                                  unsigned long pos) {
-  OFString value;
-  OFCondition status = item->findAndGetOFStringArray(tag_key, value, pos);
-  if (status.bad())
-    std::cerr << "Error on tag: " << tag_key << " -> " << status.text()
-              << std::endl;
-  return value.c_str();
-}
\ No newline at end of file
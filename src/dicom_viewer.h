@@ -1,36 +1,55 @@
 #ifndef DICOM_VIEWER_H
 #define DICOM_VIEWER_H
 
+#include <QAction>
 #include <QGridLayout>
 #include <QMainWindow>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QQuaternion>
+#include <QTimer>
 
 #include <map>
 #include <memory>
 
 #include <dcmtk/dcmdata/dctk.h>
-#include <dcmtk/dcmimgle/dcmimage.h>
 
+#include "collection_decoder.h"
+#include "dicom_collection.h"
 #include "double_slider.h"
 #include "glwidget.h"
 #include "image_label.h"
 #include "int_slider.h"
+#include "latest_job.h"
+#include "oblique_label.h"
+#include "oblique_reslice.h"
+#include "plane_extractor.h"
+#include "slice_cache.h"
+#include "volume_cache.h"
 
 class DicomViewer : public QMainWindow {
   Q_OBJECT
 
 public:
   DicomViewer(QWidget *parent = 0);
-  ~DicomViewer();
   QSize sizeHint() const { return QSize(600, 400); }
 
 public slots:
   void openDicomCollection();
   void showStats();
   void save();
+  /// Save the 3D view rendered on the CPU to an image
+  void exportVolumeView();
 
   void onSliceChange(int new_slice);
+  void onCoronalPlaneChange(int new_plane);
+  void onSagittalPlaneChange(int new_plane);
+  /// Rotate the oblique plane after a drag of (dx, dy) pixels
+  void onObliqueRotation(int dx, int dy);
+  /// Move the oblique plane along its normal by 'steps' output pixels
+  void onObliqueTranslation(int steps);
   void onWindowCenterChange(double new_window_center);
   void onWindowWidthChange(double new_window_width);
 
@@ -42,11 +61,23 @@ public slots:
   void onCheckHideBelowChange(bool check);
   void onCheckBitsChange(bool check);
 
+  /// Stage the slices decoded since the last call, the first slice which
+  /// cannot be decoded stops the loading
+  void onSlicesDecoded();
+  /// All the slices of the collection were decoded
+  void onDecodingFinished();
+  /// Stop decoding the collection, the missing slices stay empty
+  void cancelLoad();
+  /// Write the staged slices in the volume and refresh the views
+  void refreshStreamedLayers();
+
 private:
   QWidget *widget;
   QGridLayout *layout;
 
   IntSlider *slice_slider;
+  IntSlider *coronal_slider;
+  IntSlider *sagittal_slider;
   IntSlider *k_slider;
   DoubleSlider *alpha_slider;
   DoubleSlider *window_center_slider;
@@ -54,6 +85,11 @@ private:
 
   /// The area in which the image is shown
   ImageLabel *img_label;
+  /// The areas in which the reformatted planes are shown
+  ImageLabel *coronal_label;
+  ImageLabel *sagittal_label;
+  /// The area in which the oblique plane is shown
+  ObliqueLabel *oblique_label;
 
   /// The container for display of volumic data
   GLWidget *gl_widget;
@@ -67,23 +103,79 @@ private:
   QCheckBox *check_hide_below;
   QCheckBox *use_16_bits;
   QComboBox *proj_view;
+  /// If checked, the collections opened next are packed in memory
+  QAction *compress_action;
 
-  /// The files loaded by the DicomViewer, indexed by acquisition number
+  /// The headers of the files loaded by the DicomViewer, indexed by
+  /// acquisition number. Their pixel data is only available in raw_volume.
+  /// While streaming, only the files already decoded are present
   std::map<int, std::unique_ptr<DcmFileFormat>> active_files;
+  /// The path of each file of the collection, indexed by instance number
+  std::map<int, std::string> file_paths;
+  /// True if the collection was opened from volume_cache, the headers are
+  /// then only read when a slice needs them
+  bool volume_from_cache;
+
+  /// Decodes the pixel data of the collection being opened
+  CollectionDecoder decoder;
+  /// The decoded volumes of the collections opened before
+  VolumeCache volume_cache;
+  /// The collection being decoded, stored in volume_cache once all its
+  /// slices are decoded. Its headers were handed to the decoder.
+  DicomCollection decoded_collection;
+  /// The progress of the decoding, shown in the status bar while decoding
+  QProgressBar *load_progress;
+  QPushButton *cancel_load_button;
+  /// Limits the refresh rate of the views while slices are streamed
+  QTimer *stream_refresh_timer;
+  /// The slices decoded since the last refresh. They are written to the
+  /// volume by refreshStreamedLayers, once the jobs reading it are stopped.
+  CollectionDecoder::Batch staged_slices;
+  /// The range of layers of staged_slices, empty if
+  /// streamed_first_layer > streamed_last_layer
+  int streamed_first_layer;
+  int streamed_last_layer;
+  /// The window suggested by the first file of the collection
+  double default_window_center;
+  double default_window_width;
 
   /// The current displayed layer
   int current_layer;
 
-  /// The lowest instance number among active files
+  /// The lowest instance number of the collection
   int min_instance;
-  /// The highest instance number among active files
+  /// The highest instance number of the collection
   int max_instance;
 
-  /// The active Dicom image
-  DicomImage *image;
-
-  /// The 8-bits image to be shown on screen
-  uchar *img_data;
+  /// The modality values of the whole collection, decoded once when the
+  /// collection is opened. Window changes are computed from it. For paged
+  /// collections, a preview downsampled by preview_factor.
+  std::shared_ptr<RawData> raw_volume;
+  /// The modality values of collections too large for memory, the 2D views
+  /// read the bricks they show from it
+  std::shared_ptr<PagedVolume> paged_volume;
+  /// The factor by which raw_volume is downsampled, 1 unless paged
+  int preview_factor;
+  /// The 8-bit values of raw_volume with the window stored in it, shared
+  /// with the gl_widget. Null while the 16-bit values are displayed.
+  std::shared_ptr<const VolumicData> windowed_volume;
+  /// Builds the windowed volumes in the background
+  LatestJob volume_job;
+  /// The volume whose layer is wrapped by the image of img_label, kept
+  /// alive while the label shows it
+  std::shared_ptr<const VolumicData> displayed_volume;
+
+  /// Extracts the coronal and sagittal planes from raw_volume
+  PlaneExtractor plane_extractor;
+
+  /// Rotation from the axial plane to the oblique plane
+  QQuaternion oblique_orientation;
+  /// Distance from the center of the volume to the oblique plane along its
+  /// normal [mm], bounded by clampObliqueOffset
+  double oblique_offset;
+
+  /// The windowed images of the layers of raw_volume
+  SliceCache slice_cache;
 
   /// The width of a pixel in [mm]
   /// - negative value if no image is loaded
@@ -105,67 +197,79 @@ private:
   /// Retrieve access to the dataset of active slice
   /// if dataset is not available return nullptr
   DcmDataset *getDataset();
+  /// True if the values of the active slice are available in raw_volume
+  bool isSliceAvailable();
+
+  /// Store decoded_collection in volume_cache from a worker thread
+  void saveToCache();
 
-  /// Update min_instance and max_instance based on 'active_files'
-  void updateInstanceLimits();
+  /// Set the volume of plane_extractor and slice_cache, clearing them
+  void resetPlaneCaches();
 
   /// Adjust the range of the slice slider based on 'active_files'
   void updateSliceSlider();
 
+  /// Adjust the range of the coronal and sagittal sliders to the volume and
+  /// move them to the middle of the volume
+  void updatePlaneSliders();
+
   /// Adjust the size of the window based on file content
   void updateWindowSliders();
 
-  /// Load the DicomImage from the active slice
-  /// If there are no active slice available, set image to nullptr
-  void loadDicomImage();
-
-  /// Retrive the image from the given dataset
-  /// On failure, return nullptr and shows a messagebox
-  DicomImage *loadDicomImage(DcmDataset *dataset);
-
-  /// Import the default parameters from the DicomImage
+  /// Import the default window of the collection
   void applyDefaultWindow();
 
   /// Update the image based on current status of the object
   void updateImage();
 
-  /// Update the volumic_data element based on active_files
-  void updateVolumicData();
-
-  /// Update the raw_data element based on active_files
-  void updateRawData();
+  /// Update the coronal and sagittal images
+  void updateReformattedImages();
+  /// Update the image of the plane selected by the slider of 'axis'
+  void updateReformattedImage(PlaneExtractor::Axis axis);
 
-  /// Retrieve patient name from active file
-  /// return 'FAIL' if no active file is found
-  std::string getPatientName(DcmDataset *dataset);
+  /// Put the oblique plane back on the axial plane at the center of the volume
+  void resetObliquePlane();
+  /// Update the image of the oblique plane
+  void updateObliqueImage();
 
-  /// Retrieve image from active file, converting to appropriate transfer syntax
-  /// return nullptr on failure
-  DicomImage *getDicomImage();
-
-  /// Convert current Dicom Image to a QImage according to actual parameters
-  QImage getQImage();
-
-  // Returns a two elements vector with [row_spacing, col_spacing] in mm
-  std::vector<double> getPixelSpacing(DcmDataset *dataset);
+  /// Update the volumic_data element based on raw_volume and current window
+  /// The volume is built by volume_job, superseding any pending build
+  void updateVolumicData();
 
-  // Returns the position of the first voxel transmitted in a three elements
-  // vector with [x,y,z] in mm
-  std::vector<double> getImagePosition(DcmDataset *dataset);
+  /// Update the window of raw_volume and send it to the gl_widget
+  void updateRawData();
 
-  /// Extract min (and max) used (and allowed) values
+  /// Convert current layer of raw_volume to a QImage according to actual
+  /// parameters. If windowed_volume uses the current window, its layer is
+  /// wrapped without copy and 'wrapped_volume' receives it: the image is
+  /// only valid while it is held. It is reset otherwise.
+  QImage getQImage(std::shared_ptr<const VolumicData> *wrapped_volume);
+
+  /// Convert the plane selected by the slider of 'axis' to a QImage with the
+  /// current window, scaled to the physical size of its pixels
+  QImage getReformattedImage(PlaneExtractor::Axis axis);
+
+  /// Spacing between the pixels of the oblique image [mm]
+  double getObliqueSpacing();
+  /// Keep oblique_offset within the extent of raw_volume along the normal of
+  /// the oblique plane, so that the plane always crosses the volume
+  void clampObliqueOffset();
+  /// The oblique plane in the frame of raw_volume with pixels separated by
+  /// 'spacing' [mm]
+  ObliquePlane getObliquePlane(double spacing);
+  /// Resample raw_volume on the oblique plane and convert it to a QImage with
+  /// the current window
+  QImage getObliqueImage();
+
+  /// Extract min (and max) used (and allowed) values of the active slice
+  /// Used values come from raw_volume, allowed values from the header
   void getMinMax(double *min_used_value, double *max_used_value,
                  double *min_allowed_value = nullptr,
                  double *max_allowed_value = nullptr);
 
-  /// Fill min and max with the extremum values found in the active layer
-  void getFrameMinMax(DicomImage *img, double *min, double *max);
-
   /// Fill min and max with the extremum values found it all the loaded files
   void getCollectionMinMax(double *min, double *max);
 
-  void getWindow(double *min_value, double *max_value);
-
   double getSlope();
   double getIntercept();
 
@@ -174,41 +278,7 @@ private:
   double getWindowMin();
   double getWindowMax();
 
-  int getSeriesNumber(DcmDataset *dataset);
-  int getInstanceNumber(DcmDataset *dataset);
-  int getAcquisitionNumber(DcmDataset *dataset);
-
   void setCheckBoxes(bool check);
 };
 
-template <typename T>
-T getField(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos = 0);
-template <typename T>
-T getField(DcmItem *item, unsigned int g, unsigned int e,
-           unsigned long pos = 0) {
-  return getField<T>(item, DcmTagKey(g, e), pos);
-}
-
-template <>
-double getField<double>(DcmItem *item, const DcmTagKey &tag_key,
-                        unsigned long pos);
-template <>
-short int getField<short int>(DcmItem *item, const DcmTagKey &tag_key,
-                              unsigned long pos);
-template <>
-int getField<int>(DcmItem *item, const DcmTagKey &tag_key, unsigned long pos);
-template <>
-std::string getField<std::string>(DcmItem *item, const DcmTagKey &tag_key,
-                                  unsigned long pos);
-
-template <typename T>
-std::vector<T> getFieldVector(DcmItem *item, const DcmTagKey &tag_key,
-                              int fixed_size) {
-  std::vector<T> result(fixed_size);
-  for (int i = 0; i < fixed_size; i++) {
-    result[i] = getField<T>(item, tag_key, i);
-  }
-  return result;
-}
-
 #endif // DICOM_VIEWER_H
\ No newline at end of file
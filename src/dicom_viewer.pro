@@ -27,22 +27,57 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         main.cpp \
         dicom_viewer.cpp \
+        dicom_collection.cpp \
+        collection_decoder.cpp \
         image_label.cpp \
         double_slider.cpp \
-        volumic_data.cpp \
         glwidget.cpp \
-        raw_data.cpp \
-        int_slider.cpp
+        int_slider.cpp \
+        thread_pool.cpp \
+        window_level.cpp \
+        transfer_function.cpp \
+        software_renderer.cpp \
+        brick_table.cpp \
+        downsample.cpp \
+        plane_extractor.cpp \
+        oblique_reslice.cpp \
+        oblique_label.cpp \
+        slice_cache.cpp \
+        latest_job.cpp \
+        volume_cache.cpp \
+        paged_volume.cpp \
+        brick_packing.cpp \
+        render_command.cpp
 
 
 HEADERS += \
         dicom_viewer.h \
+        dicom_collection.h \
+        collection_decoder.h \
         image_label.h \
         double_slider.h \
         volumic_data.h \
         glwidget.h \
         raw_data.h \
-        int_slider.h
+        volume.h \
+        bricked_volume.h \
+        int_slider.h \
+        thread_pool.h \
+        window_level.h \
+        transfer_function.h \
+        software_renderer.h \
+        brick_table.h \
+        downsample.h \
+        plane_extractor.h \
+        oblique_reslice.h \
+        oblique_label.h \
+        slice_cache.h \
+        latest_job.h \
+        volume_cache.h \
+        paged_volume.h \
+        brick_packing.h \
+        render_command.h \
+        trilinear.h
 
 LIBS += \
         -ldcmdata \
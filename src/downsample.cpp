@@ -0,0 +1,45 @@
+#include "downsample.h"
+
+#include <algorithm>
+
+#include "thread_pool.h"
+#include "window_level.h"
+
+void downsampleAttributes(const unsigned char *grey,
+                          const unsigned char *classes, int W, int H, int D,
+                          unsigned char *out_grey,
+                          unsigned char *out_classes) {
+  int out_W = halfSize(W);
+  int out_H = halfSize(H);
+  int out_D = halfSize(D);
+  size_t layer_size = (size_t)W * H;
+  ThreadPool::getInstance().parallelFor(0, out_D, [&](int out_z) {
+    int z_end = std::min(2 * out_z + 2, D);
+    for (int out_y = 0; out_y < out_H; out_y++) {
+      int y_end = std::min(2 * out_y + 2, H);
+      size_t out_line = ((size_t)out_z * out_H + out_y) * out_W;
+      for (int out_x = 0; out_x < out_W; out_x++) {
+        int x_end = std::min(2 * out_x + 2, W);
+        int grey_sum = 0;
+        int nb_voxels = 0;
+        int max_class = -1;
+        for (int z = 2 * out_z; z < z_end; z++) {
+          for (int y = 2 * out_y; y < y_end; y++) {
+            size_t line = z * layer_size + (size_t)y * W;
+            for (int x = 2 * out_x; x < x_end; x++) {
+              grey_sum += grey[line + x];
+              nb_voxels++;
+              if (classes && classes[line + x] != NO_CLASS)
+                max_class = std::max(max_class, (int)classes[line + x]);
+            }
+          }
+        }
+        out_grey[out_line + out_x] =
+            (unsigned char)((grey_sum + nb_voxels / 2) / nb_voxels);
+        if (classes)
+          out_classes[out_line + out_x] =
+              max_class < 0 ? NO_CLASS : (unsigned char)max_class;
+      }
+    }
+  });
+}
@@ -0,0 +1,20 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <cstddef>
+
+/// Dimension of a volume of 'size' voxels downsampled by 2
+inline int halfSize(int size) { return (size + 1) / 2; }
+
+/// Downsample by 2 along each dimension the display attributes of a volume of
+/// W*H*D voxels, the output has halfSize(W)*halfSize(H)*halfSize(D) voxels.
+/// Each output voxel summarizes the (up to) 8 voxels it covers:
+/// - grey: rounded average of the grey levels
+/// - classes: highest class among the voxels inside the window, NO_CLASS if
+///   all of them are outside. Ignored if 'classes' is null.
+/// Slabs of layers are processed in parallel on the ThreadPool.
+void downsampleAttributes(const unsigned char *grey,
+                          const unsigned char *classes, int W, int H, int D,
+                          unsigned char *out_grey, unsigned char *out_classes);
+
+#endif // DOWNSAMPLE_H
@@ -5,18 +5,53 @@
 
 #include "glwidget.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#include "downsample.h"
+#include "window_level.h"
+
+/// Number of levels of detail, including the full resolution
+static const int nb_lod_levels = 4;
+/// Drawing rate targeted during interaction
+static const double lod_target_fps = 30;
+/// Delay without interaction before drawing at full resolution [ms]
+static const int lod_idle_delay = 300;
+
 GLWidget::GLWidget(QWidget *parent)
-    : QOpenGLWidget(parent), alpha(0.05), log2_zoom(0),
-      view_type(ViewType::ORTHO),hide_empty_points(false),highlight(false),hide_above(false),hide_below(false),change_bit_encode(false){
+    : QOpenGLWidget(parent), alpha(0.05), k(1), log2_zoom(0),
+      view_type(ViewType::ORTHO),hide_empty_points(false),highlight(false),hide_above(false),hide_below(false),change_bit_encode(false),
+      display_width(0), display_height(0), display_depth(0),
+      lod_outdated(true), interacting(false), lod_frame_ms(nb_lod_levels, 0),
+      grey_buffer(QOpenGLBuffer::VertexBuffer),
+      class_buffer(QOpenGLBuffer::VertexBuffer), grey_outdated(true),
+      classes_outdated(true), quad_buffer(QOpenGLBuffer::VertexBuffer),
+      volume_texture_source(nullptr), multi_draw_arrays(nullptr),
+      current_slice(0) {
+  idle_timer.setSingleShot(true);
+  idle_timer.setInterval(lod_idle_delay);
+  connect(&idle_timer, SIGNAL(timeout()), this, SLOT(onInteractionIdle()));
   QSizePolicy size_policy;
   size_policy.setVerticalPolicy(QSizePolicy::MinimumExpanding);
   size_policy.setHorizontalPolicy(QSizePolicy::MinimumExpanding);
   setSizePolicy(size_policy);
 }
 
-GLWidget::~GLWidget() {}
+GLWidget::~GLWidget() {
+  makeCurrent();
+  grey_buffer.destroy();
+  class_buffer.destroy();
+  quad_buffer.destroy();
+  volume_texture.reset();
+  transfer_texture.reset();
+  empty_bricks_texture.reset();
+  for (auto &level : lod_levels) {
+    level->grey_buffer.destroy();
+    level->class_buffer.destroy();
+  }
+  doneCurrent();
+}
 
 float GLWidget::getAlpha() const { return alpha; }
 
@@ -27,146 +62,505 @@ void GLWidget::setAlpha(double new_alpha) {
 
 void GLWidget::setK(int new_k){
   k = new_k;
+  // Only the classes depend on k
+  if (change_bit_encode)
+    updateAttributes();
   update();
 }
 
 void GLWidget::setProj(int index) {
   if(index == 0)
     view_type = ViewType::ORTHO;
-  else
+  else if(index == 1)
     view_type = ViewType::FRUSTUM;
+  else
+    view_type = ViewType::RAYMARCH;
   update();
 }
 
-void GLWidget::updateVolumicData(std::unique_ptr<VolumicData> new_data) {
+void GLWidget::setHideEmptyPoints(bool check) {
+  hide_empty_points = check;
+  updateBrickVisibility();
+}
+
+void GLWidget::setBitEncode(bool check) {
+  change_bit_encode = check;
+  updateAttributes();
+}
+
+void GLWidget::updateVolumicData(
+    std::shared_ptr<const VolumicData> new_data) {
   volumic_data = std::move(new_data);
-  updateDisplayPoints();
+  updateGeometry();
+  if (!change_bit_encode)
+    updateAttributes();
 }
 
-void GLWidget::updateRawData(std::unique_ptr<RawData> new_data) {
+void GLWidget::updateRawData(std::shared_ptr<RawData> new_data) {
+  // The window is stored in the volume, the bricks only change with the data
+  if (new_data != raw_data) {
+    if (new_data)
+      brick_table.build(*new_data);
+    else
+      brick_table = BrickTable();
+    brick_visible.clear();
+  }
   raw_data = std::move(new_data);
-  updateDisplayPoints();
+  // Without the 8-bit volume, the geometry is the one of the raw data
+  if (!volumic_data)
+    updateGeometry();
+  if (change_bit_encode)
+    updateAttributes();
+  else
+    updateBrickVisibility();
 }
 
-void GLWidget::updateDisplayPoints() {
-  display_points.clear();
-  if (!volumic_data)
+void GLWidget::updateRawDataLayers(int first_layer, int last_layer) {
+  if (!raw_data)
     return;
-  int W = volumic_data->width;
-  int H = volumic_data->height;
-  int D = volumic_data->depth;
-  int col = 0;
-  int row = 0;
-  int depth = 0;
-  double x_factor = volumic_data->pixel_width;
-  double y_factor = volumic_data->pixel_height;
-  double z_factor = volumic_data->slice_spacing;
-  double max_size =
-      std::max(std::max(x_factor * W, y_factor * H), z_factor * D);
-  double global_factor = 2.0 / max_size;
-  x_factor *= global_factor;
-  y_factor *= global_factor;
-  z_factor *= global_factor;
-  int idx_start = 0;
-  int idx_end = W * H * D;
-  display_points.reserve(idx_end - idx_start);
-  // Importing points
-  for (int idx = idx_start; idx < idx_end; idx++) {
-    double c;
-    DrawablePoint p;
-    /* 8-bit colors */
-    if(!change_bit_encode){
-      c = volumic_data->data[idx] / 255.0;
-      p.c = c;
-    /* 16-bit colors */
-    } else {
-      c = raw_data->data[idx];
-      if(c < raw_data->w_min){
-        p.c = 0.0;
-        p.vol_idx = -1;
-      } else if(c >= raw_data->w_max) {
-        p.c = 1.0;
-        if(c == raw_data->w_max)
-          p.vol_idx = k;
-        else
-          p.vol_idx = -1;
-      } else {
-        p.c = (c - raw_data->w_min) / (raw_data->w_max - raw_data->w_min);
-        p.vol_idx = floor(k * p.c);
+  brick_table.updateLayers(*raw_data, first_layer, last_layer);
+  software_renderer.updateLayers(first_layer, last_layer);
+  // The whole texture is sent again on next ray marching
+  volume_texture_source = nullptr;
+  if (change_bit_encode)
+    updateAttributes();
+  else
+    updateBrickVisibility();
+}
+
+void GLWidget::stopRawDataJobs() {
+  attributes_job.cancel();
+  attributes_job.wait();
+}
+
+void GLWidget::updateGeometry() {
+  int W = 0, H = 0, D = 0;
+  QVector3D new_voxel_size;
+  if (volumic_data) {
+    W = volumic_data->width;
+    H = volumic_data->height;
+    D = volumic_data->depth;
+    new_voxel_size =
+        getVoxelSize(W, H, D, volumic_data->pixel_width,
+                     volumic_data->pixel_height, volumic_data->slice_spacing);
+  } else if (raw_data) {
+    // The 8-bit volume is not built for the 16-bit encoding
+    W = raw_data->width;
+    H = raw_data->height;
+    D = raw_data->depth;
+    new_voxel_size =
+        getVoxelSize(W, H, D, raw_data->pixel_width, raw_data->pixel_height,
+                     raw_data->slice_spacing);
+  }
+  if (W == display_width && H == display_height && D == display_depth &&
+      new_voxel_size == voxel_size)
+    return;
+  display_width = W;
+  display_height = H;
+  display_depth = D;
+  voxel_size = new_voxel_size;
+  // All attributes and draw ranges have to match the new dimensions
+  layer_runs.clear();
+  std::fill(lod_frame_ms.begin(), lod_frame_ms.end(), 0);
+  updateAttributes();
+}
+
+void GLWidget::updateAttributes() {
+  size_t nb_voxels = (size_t)display_width * display_height * display_depth;
+  bool use_16_bits =
+      change_bit_encode && raw_data && raw_data->size() == nb_voxels;
+  /* Only the window or k changed: the previous attributes are drawn until
+   * the new ones are computed in the background */
+  if (use_16_bits && display_grey.size() == nb_voxels) {
+    startAttributesJob();
+    return;
+  }
+  // Results of a running job would not match anymore
+  attributes_job.cancel();
+  /* 8-bit colors are read directly from volumic_data */
+  if (!use_16_bits) {
+    std::vector<unsigned char>().swap(display_grey);
+    std::vector<unsigned char>().swap(display_classes);
+  }
+  /* 16-bit colors: grey levels and classes are computed in a single pass */
+  else {
+    display_grey.resize(nb_voxels);
+    display_classes.resize(nb_voxels);
+    applyWindowToVolume(raw_data->data(),
+                        (size_t)display_width * display_height, display_depth,
+                        raw_data->window_center, raw_data->window_width,
+                        display_grey.data(), display_classes.data(), k);
+    classes_outdated = true;
+  }
+  grey_outdated = true;
+  lod_outdated = true;
+  updateBrickVisibility();
+}
+
+void GLWidget::startAttributesJob() {
+  struct Attributes {
+    std::vector<unsigned char> grey;
+    std::vector<unsigned char> classes;
+  };
+  std::shared_ptr<Attributes> result = std::make_shared<Attributes>();
+  std::shared_ptr<const RawData> volume = raw_data;
+  size_t layer_size = (size_t)display_width * display_height;
+  int depth = display_depth;
+  double window_center = raw_data->window_center;
+  double window_width = raw_data->window_width;
+  int job_k = k;
+  attributes_job.start(
+      [=](const std::atomic<bool> &cancelled) {
+        result->grey.resize(layer_size * depth);
+        result->classes.resize(layer_size * depth);
+        return applyWindowToVolume(volume->data(), layer_size, depth,
+                                   window_center, window_width,
+                                   result->grey.data(),
+                                   result->classes.data(), job_k, &cancelled);
+      },
+      [this, result, volume]() {
+        // Changes of volume or encoding cancel the job, this is a safety net
+        if (volume != raw_data || !change_bit_encode ||
+            display_grey.size() != result->grey.size())
+          return;
+        display_grey.swap(result->grey);
+        display_classes.swap(result->classes);
+        grey_outdated = true;
+        classes_outdated = true;
+        lod_outdated = true;
+        updateBrickVisibility();
+        update();
+      });
+}
+
+void GLWidget::updateBrickVisibility() {
+  size_t nb_bricks = brick_table.size();
+  std::vector<bool> visible(nb_bricks, true);
+  bool use_bricks = raw_data && raw_data->width == display_width &&
+                    raw_data->height == display_height &&
+                    raw_data->depth == display_depth;
+  if (use_bricks) {
+    double window_center = raw_data->window_center;
+    double window_width = raw_data->window_width;
+    // Grey levels increase with the values: a brick is empty if the grey
+    // level of its maximum is 0
+    std::vector<unsigned char> max_grey(nb_bricks);
+    applyWindow(brick_table.getMaxs().data(), nb_bricks, window_center,
+                window_width, max_grey.data());
+    int class_min, class_max;
+    getWindowBounds(window_center, window_width, &class_min, &class_max);
+    for (size_t i = 0; i < nb_bricks; i++) {
+      bool empty = hide_empty_points && max_grey[i] == 0;
+      bool outside = change_bit_encode && (brick_table.getMax(i) < class_min ||
+                                           brick_table.getMin(i) > class_max);
+      visible[i] = !empty && !outside;
+    }
+  } else {
+    visible.clear();
+  }
+  if (visible == brick_visible && !layer_runs.empty())
+    return;
+  brick_visible.swap(visible);
+  updateDrawRanges();
+}
+
+void GLWidget::updateDrawRanges() {
+  draw_firsts.clear();
+  draw_counts.clear();
+  layer_runs.assign(1, 0);
+  size_t layer_size = (size_t)display_width * display_height;
+  const int brick_size = BrickTable::BRICK_SIZE;
+  int bricks_x = brick_table.getBricksX();
+  for (int z = 0; z < display_depth; z++) {
+    // Without bricks, all the voxels are drawn
+    if (brick_visible.empty()) {
+      draw_firsts.push_back((GLint)(z * layer_size));
+      draw_counts.push_back((GLsizei)layer_size);
+      layer_runs.push_back(draw_counts.size());
+      continue;
+    }
+    // Runs do not cross layers, so that layers can be selected
+    GLint run_first = 0;
+    GLsizei run_count = 0;
+    for (int y = 0; y < display_height; y++) {
+      size_t brick_line = brick_table.getIndex(0, y / brick_size,
+                                               z / brick_size);
+      GLint line_first = (GLint)(z * layer_size + (size_t)y * display_width);
+      for (int bx = 0; bx < bricks_x; bx++) {
+        if (!brick_visible[brick_line + bx])
+          continue;
+        GLint first = line_first + bx * brick_size;
+        GLsizei count = std::min(brick_size, display_width - bx * brick_size);
+        // Extending the current run when the voxels are contiguous
+        if (run_count > 0 && run_first + run_count == first) {
+          run_count += count;
+          continue;
+        }
+        if (run_count > 0) {
+          draw_firsts.push_back(run_first);
+          draw_counts.push_back(run_count);
+        }
+        run_first = first;
+        run_count = count;
       }
     }
-    p.pos = QVector3D((col - W / 2.) * x_factor, (row - H / 2.) * y_factor,
-                      (depth - D / 2.) * z_factor);
-    p.depth = depth;
-    display_points.push_back(p);
-    col++;
-    if (col == W) {
-      row++;
-      col = 0;
+    if (run_count > 0) {
+      draw_firsts.push_back(run_first);
+      draw_counts.push_back(run_count);
     }
-    if (row == H) {
-      depth++;
-      row = 0;
+    layer_runs.push_back(draw_counts.size());
+  }
+}
+
+const unsigned char *GLWidget::getDisplayGrey() const {
+  if (change_bit_encode)
+    return display_grey.data();
+  return volumic_data ? volumic_data->data() : nullptr;
+}
+
+QVector3D GLWidget::getVoxelPosition(int col, int row, int depth) const {
+  return QVector3D((col - display_width / 2.) * voxel_size.x(),
+                   (row - display_height / 2.) * voxel_size.y(),
+                   (depth - display_depth / 2.) * voxel_size.z());
+}
+
+/// The position of a point is deduced from its index in the volume, its
+/// color from its attributes and the drawing options. Hidden layers are not
+/// drawn at all and the highlighted layer is drawn separately as opaque.
+static const char *point_vertex_shader = R"(
+#version 130
+in float grey;
+in float vol_class;
+
+uniform mat4 mvp;
+uniform ivec3 dims;
+uniform vec3 origin;
+uniform vec3 voxel_size;
+uniform float alpha;
+uniform bool opaque;
+uniform bool hide_empty_points;
+uniform bool use_classes;
+uniform vec4 palette[7];
+
+out vec4 color;
+
+void main() {
+  int layer_size = dims.x * dims.y;
+  int depth = gl_VertexID / layer_size;
+  int layer_idx = gl_VertexID - depth * layer_size;
+  int row = layer_idx / dims.x;
+  int col = layer_idx - row * dims.x;
+  vec3 pos = origin + vec3(col, row, depth) * voxel_size;
+  gl_Position = mvp * vec4(pos, 1.0);
+
+  float point_alpha = opaque ? 1.0 : alpha;
+  if (hide_empty_points && grey == 0.0)
+    point_alpha = 0.0;
+  if (use_classes) {
+    int class_idx = int(vol_class * 255.0 + 0.5);
+    if (class_idx > 6) {
+      // Points outside of the window are not drawn: moved beyond far plane
+      gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+      color = vec4(0.0);
+      return;
+    }
+    color = vec4(palette[class_idx].rgb, point_alpha);
+  } else {
+    color = vec4(vec3(grey), point_alpha);
+  }
+}
+)";
+
+static const char *point_fragment_shader = R"(
+#version 130
+in vec4 color;
+
+void main() {
+  gl_FragColor = color;
+}
+)";
+
+/// Ray marching is done for each pixel of a quad covering the viewport
+static const char *raymarch_vertex_shader = R"(
+#version 130
+in vec2 quad_pos;
+
+out vec2 ndc;
+
+void main() {
+  ndc = quad_pos;
+  gl_Position = vec4(quad_pos, 0.0, 1.0);
+}
+)";
+
+/// The ray of each pixel is marched front-to-back through the volume, samples
+/// are colored by the transfer function and composited until the
+/// accumulated opacity is almost opaque
+static const char *raymarch_fragment_shader = R"(
+#version 130
+in vec2 ndc;
+
+uniform mat4 inv_mvp;
+uniform vec3 dims;
+uniform vec3 extent;
+uniform sampler3D volume;
+uniform sampler1D transfer_function;
+uniform vec2 tf_range;
+uniform float z_min;
+uniform float z_max;
+uniform int current_slice;
+uniform bool highlight;
+uniform sampler3D empty_bricks;
+uniform vec3 bricks;
+uniform float brick_size;
+
+void main() {
+  // Ray from the near plane to the far plane in texture coordinates
+  vec4 near_pos = inv_mvp * vec4(ndc, -1.0, 1.0);
+  vec4 far_pos = inv_mvp * vec4(ndc, 1.0, 1.0);
+  vec3 origin = near_pos.xyz / near_pos.w / extent + 0.5 + 0.5 / dims;
+  vec3 target = far_pos.xyz / far_pos.w / extent + 0.5 + 0.5 / dims;
+  vec3 dir = target - origin;
+  // Avoiding divisions by 0 for axis-aligned rays
+  dir += vec3(equal(dir, vec3(0.0))) * 1e-7;
+  vec3 t0 = (vec3(0.0, 0.0, z_min) - origin) / dir;
+  vec3 t1 = (vec3(1.0, 1.0, z_max) - origin) / dir;
+  vec3 t_min = min(t0, t1);
+  vec3 t_max = max(t0, t1);
+  float t_enter = max(max(t_min.x, t_min.y), max(t_min.z, 0.0));
+  float t_exit = min(min(t_max.x, t_max.y), min(t_max.z, 1.0));
+  if (t_enter >= t_exit)
+    discard;
+  // One sample per voxel crossed
+  float dt = 1.0 / length(dir * dims);
+  float tf_scale = 1.0 / (tf_range.y - tf_range.x);
+  vec4 acc = vec4(0.0);
+  int i = 0;
+  for (int iter = 0; iter < 8192; iter++) {
+    float t = t_enter + (float(i) + 0.5) * dt;
+    if (t > t_exit)
+      break;
+    vec3 pos = origin + t * dir;
+    // Jumping to the exit of transparent bricks, the first and last bricks
+    // extend beyond the volume
+    vec3 voxel = clamp(pos * dims - 0.5, vec3(0.0), dims - 1.0);
+    vec3 brick = min(floor(voxel / brick_size), bricks - 1.0);
+    if (texture(empty_bricks, (brick + 0.5) / bricks).r > 0.5) {
+      vec3 lower = mix((brick * brick_size + 0.5) / dims, vec3(-1e9),
+                       vec3(equal(brick, vec3(0.0))));
+      vec3 upper = mix(((brick + 1.0) * brick_size + 0.5) / dims, vec3(1e9),
+                       vec3(equal(brick, bricks - 1.0)));
+      vec3 t_out = max((lower - origin) / dir, (upper - origin) / dir);
+      float t_brick = min(min(t_out.x, t_out.y), min(t_out.z, t_exit));
+      i = max(i + 1, int(ceil((t_brick - t_enter) / dt - 0.5)));
+      continue;
     }
+    float value = texture(volume, pos).r * 32767.0;
+    vec4 s = texture(transfer_function, (value - tf_range.x) * tf_scale);
+    if (highlight && s.a > 0.0 && int(pos.z * dims.z) == current_slice)
+      s.a = 1.0;
+    acc.rgb += (1.0 - acc.a) * s.a * s.rgb;
+    acc.a += (1.0 - acc.a) * s.a;
+    // Early ray termination
+    if (acc.a > 0.99)
+      break;
+    i++;
   }
-  //std::cout << "Nb points: " << display_points.size() << std::endl;
+  gl_FragColor = acc;
 }
+)";
+
+/// Number of entries of the transfer function texture
+static const int transfer_function_size = 4096;
+
+/// Attribute locations of the point program, grey is always enabled and uses
+/// location 0 as required by some compatibility profiles
+static const int grey_location = 0;
+static const int class_location = 1;
 
 void GLWidget::initializeGL() {
+  initializeOpenGLFunctions();
   glEnable(GL_BLEND);
   glDisable(GL_DEPTH_TEST);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glDepthFunc(GL_NEVER);
+
+  point_program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                        point_vertex_shader);
+  point_program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                        point_fragment_shader);
+  point_program.bindAttributeLocation("grey", grey_location);
+  point_program.bindAttributeLocation("vol_class", class_location);
+  if (!point_program.link())
+    std::cerr << "Failed to link point program: "
+              << point_program.log().toStdString() << std::endl;
+  grey_buffer.create();
+  class_buffer.create();
+  multi_draw_arrays = reinterpret_cast<MultiDrawArrays>(
+      context()->getProcAddress("glMultiDrawArrays"));
+  grey_outdated = true;
+  classes_outdated = true;
+
+  raymarch_program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                           raymarch_vertex_shader);
+  raymarch_program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                           raymarch_fragment_shader);
+  raymarch_program.bindAttributeLocation("quad_pos", 0);
+  if (!raymarch_program.link())
+    std::cerr << "Failed to link ray marching program: "
+              << raymarch_program.log().toStdString() << std::endl;
+  const GLfloat quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+  quad_buffer.create();
+  quad_buffer.bind();
+  quad_buffer.allocate(quad, sizeof(quad));
+  quad_buffer.release();
+  volume_texture_source = nullptr;
 }
 
-void GLWidget::getColor(DrawablePoint point, double alpha) {
-  if(change_bit_encode){
-    switch(point.vol_idx){
-      case 0:
-        glColor4f(1.0, 0.0, 0.0, alpha);
-        break;
-      case 1:
-        glColor4f(0.0, 1.0, 0.0, alpha);
-        break;
-      case 2:
-        glColor4f(0.0, 0.0, 1.0, alpha);
-        break;
-      case 3:
-        glColor4f(1.0, 1.0, 0.0, alpha);
-        break;
-      case 4:
-        glColor4f(1.0, 0.0, 1.0, alpha);
-        break;
-      case 5:
-        glColor4f(0.0, 1.0, 1.0, alpha);
-        break;
-      case 6:
-        glColor4f(1.0, 1.0, 1.0, alpha);
-        break;
-    }
-  } else {
-    glColor4f(point.c, point.c, point.c, alpha);
+void GLWidget::uploadBuffers() {
+  size_t nb_voxels = (size_t)display_width * display_height * display_depth;
+  if (grey_outdated) {
+    uploadBuffer(&grey_buffer, nb_voxels > 0 ? getDisplayGrey() : nullptr,
+                 nb_voxels);
+    grey_outdated = false;
+  }
+  if (classes_outdated) {
+    uploadBuffer(&class_buffer, display_classes.data(),
+                 display_classes.size());
+    classes_outdated = false;
   }
 }
 
-void GLWidget::paintGL() {
-  QSize viewport_size = size();
-  int width = viewport_size.width();
-  int height = viewport_size.height();
-  double aspect_ratio = width / (float)height;
-  glViewport(0, 0, width, height);
-
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
+void GLWidget::uploadBuffer(QOpenGLBuffer *buffer, const unsigned char *data,
+                            size_t size) {
+  buffer->bind();
+  // Reusing the storage when the geometry did not change
+  if ((size_t)buffer->size() == size)
+    buffer->write(0, data, (int)size);
+  else
+    buffer->allocate(data, (int)size);
+  buffer->release();
+}
+
+QMatrix4x4 GLWidget::getViewMatrix() const {
+  return getViewMatrix(view_type, transform, log2_zoom,
+                       width() / (float)height());
+}
+
+QMatrix4x4 GLWidget::getViewMatrix(ViewType view_type,
+                                   const QMatrix4x4 &transform,
+                                   float log2_zoom, double aspect_ratio) {
+  QMatrix4x4 pov;
   switch (view_type) {
-    case ViewType::ORTHO: {
+    case ViewType::ORTHO:
+    case ViewType::RAYMARCH: {
       double view_half_size = std::pow(2, -log2_zoom);
-      glScalef(1.0, aspect_ratio, 1.0);
+      pov.scale(1.0, aspect_ratio, 1.0);
       QVector3D center(0, 0, 0);
-      glOrtho(center.x() - view_half_size, center.x() + view_half_size,
-              center.y() - view_half_size, center.y() + view_half_size,
-              center.z() - view_half_size, center.z() + view_half_size);
-      glMultMatrixf(transform.constData());
+      pov.ortho(center.x() - view_half_size, center.x() + view_half_size,
+                center.y() - view_half_size, center.y() + view_half_size,
+                center.z() - view_half_size, center.z() + view_half_size);
+      pov *= transform;
       break;
     }
     case ViewType::FRUSTUM: {
@@ -176,41 +570,367 @@ void GLWidget::paintGL() {
       projection.perspective(90, aspect_ratio, near_dist, far_dist);
       QMatrix4x4 cam_offset;
       cam_offset.translate(0, 0, -2 * (1 - log2_zoom));
-      QMatrix4x4 pov = projection * cam_offset * transform;
-      glMultMatrixf(pov.constData());
+      pov = projection * cam_offset * transform;
     }
   }
-  
-  glMatrixMode(GL_MODELVIEW);
+  return pov;
+}
 
+QVector3D GLWidget::getVoxelSize(int W, int H, int D, double pixel_width,
+                                 double pixel_height, double slice_spacing) {
+  double max_size = std::max(std::max(pixel_width * W, pixel_height * H),
+                             slice_spacing * D);
+  double global_factor = 2.0 / max_size;
+  return QVector3D(pixel_width, pixel_height, slice_spacing) * global_factor;
+}
+
+void GLWidget::paintGL() {
+  glViewport(0, 0, width(), height());
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glLoadIdentity();
-
-  glBegin(GL_POINTS);
-  for (const DrawablePoint &p : display_points) {
-    if (p.vol_idx != -1 || !change_bit_encode){
-      if ((hide_empty_points && p.c == 0) ||
-        (hide_above && p.depth > current_slice) ||
-          (hide_below && p.depth < current_slice))
-      {
-        getColor(p, 0.0);
-      }
-      else{
-        if (highlight && p.depth == current_slice)
-        {
-          getColor(p, 1.0);
-        }
-        else{
-          getColor(p, alpha);
-        }
-      }
-      glVertex3d(p.pos.x(), p.pos.y(), p.pos.z());
+
+  if (view_type == ViewType::RAYMARCH) {
+    paintRayMarching();
+    return;
+  }
+  if (!interacting) {
+    paintPoints(0);
+    return;
+  }
+  int lod_level = chooseLodLevel();
+  QElapsedTimer timer;
+  timer.start();
+  paintPoints(lod_level);
+  // Waiting for the GPU to measure the actual cost of the level, static
+  // views are not measured so that they do not stall the pipeline
+  glFinish();
+  double frame_ms = timer.nsecsElapsed() / 1e6;
+  double &average_ms = lod_frame_ms[lod_level];
+  average_ms = average_ms == 0 ? frame_ms : 0.8 * average_ms + 0.2 * frame_ms;
+}
+
+void GLWidget::paintPoints(int lod_level) {
+  size_t nb_voxels = (size_t)display_width * display_height * display_depth;
+  if (nb_voxels == 0 || !point_program.isLinked())
+    return;
+  // Classes are not computed without raw data
+  if (change_bit_encode && display_classes.size() != nb_voxels)
+    return;
+  // The 8-bit volume is being built after a switch from 16-bit
+  if (!change_bit_encode && !volumic_data)
+    return;
+  uploadBuffers();
+  if (layer_runs.size() != (size_t)display_depth + 1)
+    updateDrawRanges();
+  if (lod_level > 0 && lod_outdated)
+    updateLodLevels();
+
+  // A point of level i covers a cube of 2^i voxels
+  int factor = 1 << lod_level;
+  int W = display_width, H = display_height, D = display_depth;
+  QOpenGLBuffer *level_grey = &grey_buffer;
+  QOpenGLBuffer *level_classes = &class_buffer;
+  if (lod_level > 0) {
+    LodLevel &level = *lod_levels[lod_level - 1];
+    W = level.width;
+    H = level.height;
+    D = level.depth;
+    level_grey = &level.grey_buffer;
+    level_classes = &level.class_buffer;
+  }
+  QVector3D full_dims(display_width, display_height, display_depth);
+  QVector3D half_point(factor - 1, factor - 1, factor - 1);
+  QVector3D origin = (half_point / 2 - full_dims / 2) * voxel_size;
+  // Keeping the opacity of a line of sight with fewer points
+  float level_alpha = 1 - std::pow(1 - alpha, factor);
+
+  point_program.bind();
+  point_program.setUniformValue("mvp", getViewMatrix());
+  glUniform3i(point_program.uniformLocation("dims"), W, H, D);
+  point_program.setUniformValue("origin", origin);
+  point_program.setUniformValue("voxel_size", voxel_size * factor);
+  point_program.setUniformValue("alpha", level_alpha);
+  point_program.setUniformValue("opaque", 0);
+  point_program.setUniformValue("hide_empty_points", (int)hide_empty_points);
+  point_program.setUniformValue("use_classes", (int)change_bit_encode);
+  point_program.setUniformValueArray("palette", CLASS_PALETTE,
+                                     CLASS_PALETTE_SIZE);
+
+  level_grey->bind();
+  glEnableVertexAttribArray(grey_location);
+  glVertexAttribPointer(grey_location, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0,
+                        nullptr);
+  if (change_bit_encode) {
+    level_classes->bind();
+    glEnableVertexAttribArray(class_location);
+    glVertexAttribPointer(class_location, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0,
+                          nullptr);
+  }
+  // Hidden layers and highlight are selections of layers of the level, a
+  // point of the level covers the current slice if it contains it
+  int current = std::min(std::max(current_slice / factor, 0), D - 1);
+  int first_layer = hide_below ? current : 0;
+  int last_layer = hide_above ? current : D - 1;
+  if (highlight) {
+    drawLayers(lod_level, first_layer, current - 1);
+    point_program.setUniformValue("opaque", 1);
+    drawLayers(lod_level, current, current);
+    point_program.setUniformValue("opaque", 0);
+    drawLayers(lod_level, current + 1, last_layer);
+  } else {
+    drawLayers(lod_level, first_layer, last_layer);
+  }
+  glDisableVertexAttribArray(grey_location);
+  glDisableVertexAttribArray(class_location);
+  level_classes->release();
+  point_program.release();
+}
+
+void GLWidget::drawLayers(int lod_level, int first_layer, int last_layer) {
+  if (first_layer > last_layer)
+    return;
+  if (lod_level > 0) {
+    // Coarse levels are small enough to be drawn entirely
+    const LodLevel &level = *lod_levels[lod_level - 1];
+    size_t layer_size = (size_t)level.width * level.height;
+    glDrawArrays(GL_POINTS, (GLint)(first_layer * layer_size),
+                 (GLsizei)((last_layer - first_layer + 1) * layer_size));
+    return;
+  }
+  // Only the voxels of the visible bricks are sent
+  size_t first_run = layer_runs[first_layer];
+  size_t end_run = layer_runs[last_layer + 1];
+  if (first_run == end_run)
+    return;
+  if (multi_draw_arrays) {
+    multi_draw_arrays(GL_POINTS, draw_firsts.data() + first_run,
+                      draw_counts.data() + first_run,
+                      (GLsizei)(end_run - first_run));
+  } else {
+    for (size_t i = first_run; i < end_run; i++)
+      glDrawArrays(GL_POINTS, draw_firsts[i], draw_counts[i]);
+  }
+}
+
+void GLWidget::updateLodLevels() {
+  lod_outdated = false;
+  lod_levels.resize(nb_lod_levels - 1);
+  const unsigned char *grey = getDisplayGrey();
+  const unsigned char *classes =
+      change_bit_encode ? display_classes.data() : nullptr;
+  int W = display_width, H = display_height, D = display_depth;
+  for (auto &level : lod_levels) {
+    if (!level) {
+      level.reset(new LodLevel());
+      level->grey_buffer.create();
+      level->class_buffer.create();
+    }
+    level->width = halfSize(W);
+    level->height = halfSize(H);
+    level->depth = halfSize(D);
+    size_t level_size = (size_t)level->width * level->height * level->depth;
+    level->grey.resize(level_size);
+    level->classes.resize(classes ? level_size : 0);
+    downsampleAttributes(grey, classes, W, H, D, level->grey.data(),
+                         classes ? level->classes.data() : nullptr);
+    uploadBuffer(&level->grey_buffer, level->grey.data(), level->grey.size());
+    uploadBuffer(&level->class_buffer, level->classes.data(),
+                 level->classes.size());
+    // Each level is built from the previous one
+    grey = level->grey.data();
+    classes = classes ? level->classes.data() : nullptr;
+    W = level->width;
+    H = level->height;
+    D = level->depth;
+  }
+}
+
+int GLWidget::chooseLodLevel() const {
+  double budget_ms = 1000 / lod_target_fps;
+  for (int level = 0; level < nb_lod_levels; level++) {
+    if (estimateFrameTime(level) <= budget_ms)
+      return level;
+  }
+  return nb_lod_levels - 1;
+}
+
+double GLWidget::estimateFrameTime(int lod_level) const {
+  // Each level has 8 times less points than the previous one, the estimation
+  // uses the closest level measured
+  for (int distance = 0; distance < nb_lod_levels; distance++) {
+    for (int level : {lod_level - distance, lod_level + distance}) {
+      if (level < 0 || level >= nb_lod_levels || lod_frame_ms[level] == 0)
+        continue;
+      return lod_frame_ms[level] * std::pow(8.0, level - lod_level);
     }
   }
-  glEnd();
+  return 0;
+}
+
+void GLWidget::startInteraction() {
+  interacting = true;
+  idle_timer.start();
+}
+
+void GLWidget::onInteractionIdle() {
+  interacting = false;
+  update();
+}
+
+void GLWidget::paintRayMarching() {
+  if (!raw_data || display_width == 0 || !raymarch_program.isLinked())
+    return;
+  if (raw_data->width != display_width ||
+      raw_data->height != display_height || raw_data->depth != display_depth)
+    return;
+  if (volume_texture_source != raw_data.get())
+    uploadVolumeTexture();
+  updateTransferFunction();
+
+  QVector3D dims(display_width, display_height, display_depth);
+  // Hidden layers are removed by clipping the volume
+  float z_min = hide_below ? current_slice / dims.z() : 0;
+  float z_max = hide_above ? (current_slice + 1) / dims.z() : 1;
+
+  raymarch_program.bind();
+  raymarch_program.setUniformValue("inv_mvp", getViewMatrix().inverted());
+  raymarch_program.setUniformValue("dims", dims);
+  raymarch_program.setUniformValue("extent", dims * voxel_size);
+  raymarch_program.setUniformValue("volume", 0);
+  raymarch_program.setUniformValue("transfer_function", 1);
+  raymarch_program.setUniformValue("tf_range", transfer_function_range);
+  raymarch_program.setUniformValue("z_min", z_min);
+  raymarch_program.setUniformValue("z_max", z_max);
+  raymarch_program.setUniformValue("current_slice", current_slice);
+  raymarch_program.setUniformValue("highlight", (int)highlight);
+  raymarch_program.setUniformValue("empty_bricks", 2);
+  raymarch_program.setUniformValue(
+      "bricks", QVector3D(brick_table.getBricksX(), brick_table.getBricksY(),
+                          brick_table.getBricksZ()));
+  raymarch_program.setUniformValue("brick_size",
+                                   (float)BrickTable::BRICK_SIZE);
+  volume_texture->bind(0);
+  transfer_texture->bind(1);
+  empty_bricks_texture->bind(2);
+
+  // The shader composites the samples itself, colors are premultiplied
+  glDisable(GL_BLEND);
+  quad_buffer.bind();
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray(0);
+  quad_buffer.release();
+  glEnable(GL_BLEND);
+
+  empty_bricks_texture->release(2);
+  transfer_texture->release(1);
+  volume_texture->release(0);
+  raymarch_program.release();
+}
+
+void GLWidget::uploadVolumeTexture() {
+  volume_texture_source = raw_data.get();
+  const RawData &values = *raw_data;
+  // The modality values are used as signed normalized values, no conversion
+  // is required
+  volume_texture.reset(new QOpenGLTexture(QOpenGLTexture::Target3D));
+  volume_texture->setFormat(QOpenGLTexture::R16_SNorm);
+  volume_texture->setSize(raw_data->width, raw_data->height, raw_data->depth);
+  volume_texture->setMinMagFilters(QOpenGLTexture::Linear,
+                                   QOpenGLTexture::Linear);
+  volume_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+  volume_texture->allocateStorage(QOpenGLTexture::Red, QOpenGLTexture::Int16);
+  QOpenGLPixelTransferOptions options;
+  options.setAlignment(1);
+  volume_texture->setData(QOpenGLTexture::Red, QOpenGLTexture::Int16,
+                          values.data(), &options);
+  // The transfer function only covers the values used by the volume
+  auto minmax = std::minmax_element(values.begin(), values.end());
+  transfer_function_range = QVector2D(*minmax.first, *minmax.second);
+  if (*minmax.first == *minmax.second)
+    transfer_function_range.setY(*minmax.first + 1);
+}
+
+TransferFunction GLWidget::buildTransferFunction() const {
+  TransferFunction tf;
+  tf.build(transfer_function_range.x(), transfer_function_range.y(),
+           raw_data->window_center, raw_data->window_width, alpha, k,
+           change_bit_encode, hide_empty_points, transfer_function_size);
+  return tf;
+}
+
+void GLWidget::updateTransferFunction() {
+  TransferFunction tf = buildTransferFunction();
+  std::vector<unsigned char> rgba = tf.toRGBA8();
+  if (!transfer_texture) {
+    transfer_texture.reset(new QOpenGLTexture(QOpenGLTexture::Target1D));
+    transfer_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    transfer_texture->setSize(transfer_function_size);
+    transfer_texture->setMinMagFilters(QOpenGLTexture::Linear,
+                                       QOpenGLTexture::Linear);
+    transfer_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    transfer_texture->allocateStorage(QOpenGLTexture::RGBA,
+                                      QOpenGLTexture::UInt8);
+  }
+  transfer_texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8,
+                            rgba.data());
+
+  // The bricks are only sent again when their transparency changed
+  std::vector<unsigned char> new_empty_bricks(brick_table.size());
+  for (size_t i = 0; i < brick_table.size(); i++) {
+    bool transparent =
+        tf.isTransparent(brick_table.getMin(i), brick_table.getMax(i));
+    new_empty_bricks[i] = transparent ? 255 : 0;
+  }
+  int bricks_x = brick_table.getBricksX();
+  int bricks_y = brick_table.getBricksY();
+  int bricks_z = brick_table.getBricksZ();
+  if (empty_bricks_texture && new_empty_bricks == empty_bricks &&
+      empty_bricks_texture->width() == bricks_x &&
+      empty_bricks_texture->height() == bricks_y &&
+      empty_bricks_texture->depth() == bricks_z)
+    return;
+  empty_bricks.swap(new_empty_bricks);
+  empty_bricks_texture.reset(new QOpenGLTexture(QOpenGLTexture::Target3D));
+  empty_bricks_texture->setFormat(QOpenGLTexture::R8_UNorm);
+  empty_bricks_texture->setSize(bricks_x, bricks_y, bricks_z);
+  empty_bricks_texture->setMinMagFilters(QOpenGLTexture::Nearest,
+                                         QOpenGLTexture::Nearest);
+  empty_bricks_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+  empty_bricks_texture->allocateStorage(QOpenGLTexture::Red,
+                                        QOpenGLTexture::UInt8);
+  QOpenGLPixelTransferOptions options;
+  options.setAlignment(1);
+  empty_bricks_texture->setData(QOpenGLTexture::Red, QOpenGLTexture::UInt8,
+                                empty_bricks.data(), &options);
 }
 
-void GLWidget::mousePressEvent(QMouseEvent *event) { lastPos = event->pos(); }
+QImage GLWidget::renderSoftware(const QSize &size) {
+  if (!raw_data || raw_data->empty() || size.isEmpty())
+    return QImage();
+  // The range is usually computed when uploading the volume texture
+  auto minmax = std::minmax_element(raw_data->begin(), raw_data->end());
+  transfer_function_range = QVector2D(*minmax.first, *minmax.second);
+  QVector3D raw_voxel_size =
+      getVoxelSize(raw_data->width, raw_data->height, raw_data->depth,
+                   raw_data->pixel_width, raw_data->pixel_height,
+                   raw_data->slice_spacing);
+  software_renderer.setVolume(raw_data, raw_voxel_size);
+  software_renderer.setTransferFunction(buildTransferFunction());
+  software_renderer.setLayerRange(hide_below ? current_slice : 0,
+                                  hide_above ? current_slice
+                                             : raw_data->depth - 1);
+  software_renderer.setHighlightedLayer(highlight ? current_slice : -1);
+  return software_renderer.render(
+      getViewMatrix(view_type, transform, log2_zoom,
+                    size.width() / (float)size.height()),
+      size);
+}
+
+void GLWidget::mousePressEvent(QMouseEvent *event) {
+  lastPos = event->pos();
+  startInteraction();
+}
 
 void GLWidget::mouseMoveEvent(QMouseEvent *event) {
   double dx = modifiedDelta(event->x() - lastPos.x());
@@ -229,12 +949,14 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event) {
   }
 
   lastPos = event->pos();
+  startInteraction();
   update();
 }
 
 void GLWidget::wheelEvent(QWheelEvent *event) {
   double delta = modifiedDelta(event->delta() / 1000.0);
   log2_zoom += delta;
+  startInteraction();
   update();
 }
 
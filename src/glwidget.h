@@ -2,19 +2,32 @@
 #define GLWIDGET_H
 
 #include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
 #include <QOpenGLWidget>
 #include <QString>
+#include <QTimer>
+#include <QVector2D>
 
 #include <memory>
+#include <vector>
 
+#include "brick_table.h"
+#include "latest_job.h"
 #include "volumic_data.h"
 #include "raw_data.h"
+#include "software_renderer.h"
+#include "transfer_function.h"
 
-class GLWidget : public QOpenGLWidget {
+class GLWidget : public QOpenGLWidget, protected QOpenGLFunctions {
 public:
   Q_OBJECT
 public:
-  enum ViewType { ORTHO, FRUSTUM };
+  /// - ORTHO, FRUSTUM: voxels drawn as points with the given projection
+  /// - RAYMARCH: volume ray marched on the GPU with an orthographic projection
+  enum ViewType { ORTHO, FRUSTUM, RAYMARCH };
 
   GLWidget(QWidget *parent = 0);
   ~GLWidget();
@@ -22,12 +35,13 @@ public:
 
   float getAlpha() const;
 
+  /// Set the index of the current layer in the volume
   void setCurrentSlice(int slice) { current_slice = slice; }
-  void setHideEmptyPoints(bool check) { hide_empty_points = check; }
+  void setHideEmptyPoints(bool check);
   void setHighlight(bool check) { highlight = check; }
   void setHideAbove(bool check) { hide_above = check; }
   void setHideBelow(bool check) { hide_below = check; }
-  void setBitEncode(bool check) { change_bit_encode = check; }
+  void setBitEncode(bool check);
 
   bool getHighlight() { return highlight; }
   bool getHideAbove() { return hide_above; }
@@ -36,26 +50,126 @@ public:
 
   int getK(){return k;}
 
-  void updateVolumicData(std::unique_ptr<VolumicData> new_data);
-  void updateRawData(std::unique_ptr<RawData> new_data);
+  void updateVolumicData(std::shared_ptr<const VolumicData> new_data);
+  void updateRawData(std::shared_ptr<RawData> new_data);
+  /// The values of the layers [first_layer, last_layer] of the raw data
+  /// changed, e.g. while the volume is streamed
+  void updateRawDataLayers(int first_layer, int last_layer);
+  /// Cancel the computations reading the raw data and wait for them, before
+  /// its values are modified. updateRawDataLayers starts them again.
+  void stopRawDataJobs();
+
+  /// Ray cast the 16-bit volume on the CPU with the current view and options
+  /// return a null image if no volume is available
+  QImage renderSoftware(const QSize &size);
+
+  /// The matrix projecting the display space to a viewport with the given
+  /// aspect ratio
+  static QMatrix4x4 getViewMatrix(ViewType view_type,
+                                  const QMatrix4x4 &transform,
+                                  float log2_zoom, double aspect_ratio);
+
+  /// The size of a voxel in the display space, the largest dimension of the
+  /// volume spans [-1, 1]
+  static QVector3D getVoxelSize(int W, int H, int D, double pixel_width,
+                                double pixel_height, double slice_spacing);
 
 public slots:
   void setAlpha(double new_alpha);
   void setK(int new_k);
   void setProj(int index);
 
+private slots:
+  /// End of the interaction: the points are drawn at full resolution again
+  void onInteractionIdle();
+
 protected:
-  struct DrawablePoint {
-    QVector3D pos;
+  void initializeGL() override;
+  void paintGL() override;
+
+  /// Geometry stage: update dimensions and voxel size from volumic_data
+  /// Attributes are updated only if the geometry changed
+  void updateGeometry();
+
+  /// Attribute stage: update the grey levels and classes from the current
+  /// window, k and bit encoding, without touching the geometry. If only the
+  /// window or k changed, the 16-bit attributes are computed in background.
+  void updateAttributes();
+
+  /// Compute the 16-bit attributes of raw_data with attributes_job and
+  /// replace the current ones once done
+  void startAttributesJob();
+
+  /// Update brick_visible for the current window and options, the draw
+  /// ranges are only rebuilt if the visibility of a brick changed
+  void updateBrickVisibility();
+
+  /// Build the runs of consecutive voxels belonging to visible bricks, layer
+  /// by layer
+  void updateDrawRanges();
+
+  /// Send the outdated display attributes to the GPU buffers
+  void uploadBuffers();
+
+  /// Write 'data' to 'buffer', reusing its storage if the size is unchanged
+  void uploadBuffer(QOpenGLBuffer *buffer, const unsigned char *data,
+                    size_t size);
+
+  /// The matrix projecting the display space to the viewport
+  QMatrix4x4 getViewMatrix() const;
+
+  /// Draw the voxels as points, using the given level of detail
+  void paintPoints(int lod_level);
+
+  /// Downsampled copy of the display attributes, level 'i' is downsampled
+  /// by 2^i along each dimension. Level 0 is the displayed volume itself.
+  struct LodLevel {
+    int width;
+    int height;
     int depth;
-    double c;
-    int vol_idx;
+    std::vector<unsigned char> grey;
+    std::vector<unsigned char> classes;
+    QOpenGLBuffer grey_buffer;
+    QOpenGLBuffer class_buffer;
   };
 
-  void initializeGL() override;
-  void paintGL() override;
+  /// Draw the layers [first_layer, last_layer] of 'lod_level' with the bound
+  /// program and buffers
+  void drawLayers(int lod_level, int first_layer, int last_layer);
 
-  void updateDisplayPoints();
+  /// Build the coarse levels from the current display attributes and send
+  /// them to the GPU
+  void updateLodLevels();
+
+  /// The finest level expected to be drawn within the frame budget
+  int chooseLodLevel() const;
+
+  /// Expected drawing time of 'lod_level' from the measured ones [ms]
+  /// return 0 if no measure is available
+  double estimateFrameTime(int lod_level) const;
+
+  /// Draw coarse levels until the view stops changing for a while
+  void startInteraction();
+
+  /// Draw the volume by marching a ray through a 3D texture for each pixel
+  void paintRayMarching();
+
+  /// Send the modality values of raw_data to volume_texture
+  void uploadVolumeTexture();
+
+  /// The transfer function for window, alpha, k and the options
+  TransferFunction buildTransferFunction() const;
+
+  /// Update the transfer function texture and the empty bricks texture
+  void updateTransferFunction();
+
+  /// The grey level of the voxels in the active bit encoding, null if the
+  /// 8-bit volume is not built
+  const unsigned char *getDisplayGrey() const;
+
+  /// Position of the voxel in the display space, volume is centered on 0 and
+  /// its largest dimension spans [-1, 1]
+  QVector3D getVoxelPosition(int col, int row, int depth) const;
 
   void wheelEvent(QWheelEvent *event) override;
 
@@ -84,16 +198,91 @@ protected:
   bool hide_empty_points;
   bool highlight, hide_above, hide_below, change_bit_encode;
 
-  /// The data of all the slices stored in a single object
-  std::unique_ptr<VolumicData> volumic_data;
-  std::unique_ptr<RawData> raw_data;
+  /// The data of all the slices stored in a single object, shared with the
+  /// viewer
+  std::shared_ptr<const VolumicData> volumic_data;
+  /// The modality values of all the slices, shared with the viewer
+  std::shared_ptr<RawData> raw_data;
+
+  /// Display attributes of the voxels, stored in the order of the volume.
+  /// The positions are not stored, they are deduced from the voxel index.
+  /// - display_grey: grey level when using 16-bit values (8-bit values use
+  ///   volumic_data directly)
+  /// - display_classes: class of the voxel when using 16-bit values, NO_CLASS
+  ///   for voxels outside of the window
+  std::vector<unsigned char> display_grey;
+  std::vector<unsigned char> display_classes;
+  /// Computes the 16-bit display attributes when the window or k change,
+  /// the previous attributes are drawn until it completes
+  LatestJob attributes_job;
+
+  /// Dimensions of the displayed volume in voxels
+  int display_width;
+  int display_height;
+  int display_depth;
+
+  /// The size of a voxel in the display space
+  QVector3D voxel_size;
+
+  /// Extremum values of the bricks of raw_data, rebuilt when a new volume is
+  /// received
+  BrickTable brick_table;
+  /// Bricks containing at least one point drawn with the current window
+  std::vector<bool> brick_visible;
+  /// Runs of voxels drawn by paintPoints, as expected by glMultiDrawArrays
+  std::vector<GLint> draw_firsts;
+  std::vector<GLsizei> draw_counts;
+  /// The runs of layer z are [layer_runs[z], layer_runs[z + 1]), empty if
+  /// the runs have to be rebuilt
+  std::vector<size_t> layer_runs;
+
+  /// The coarse levels of detail, lod_levels[i] is level i + 1
+  std::vector<std::unique_ptr<LodLevel>> lod_levels;
+  /// When enabled, lod_levels are rebuilt before being drawn
+  bool lod_outdated;
+  /// Enabled while the user moves the view, coarse levels are drawn
+  bool interacting;
+  /// Detects the end of the interaction
+  QTimer idle_timer;
+  /// Average time spent drawing each level while interacting [ms], 0 if
+  /// never measured
+  std::vector<double> lod_frame_ms;
+
+  /// Draws the voxels as points, colors are computed by the shaders
+  QOpenGLShaderProgram point_program;
+  /// The display attributes stored on the GPU
+  QOpenGLBuffer grey_buffer;
+  QOpenGLBuffer class_buffer;
+  /// When enabled, the buffer is uploaded before next drawing
+  bool grey_outdated;
+  bool classes_outdated;
+
+  /// Ray marching of the volume stored in a 3D texture
+  QOpenGLShaderProgram raymarch_program;
+  /// A quad covering the viewport
+  QOpenGLBuffer quad_buffer;
+  std::unique_ptr<QOpenGLTexture> volume_texture;
+  /// The volume currently stored in volume_texture
+  const RawData *volume_texture_source;
+  /// The color and opacity of modality values in transfer_function_range
+  std::unique_ptr<QOpenGLTexture> transfer_texture;
+  QVector2D transfer_function_range;
+  /// 255 for the bricks that are transparent with the transfer function,
+  /// used by the shader to skip them
+  std::unique_ptr<QOpenGLTexture> empty_bricks_texture;
+  std::vector<unsigned char> empty_bricks;
+
+  /// glMultiDrawArrays is not part of QOpenGLFunctions
+  typedef void(QOPENGLF_APIENTRYP MultiDrawArrays)(GLenum mode,
+                                                   const GLint *first,
+                                                   const GLsizei *count,
+                                                   GLsizei draw_count);
+  MultiDrawArrays multi_draw_arrays;
 
-  /// The points to be drawn
-  std::vector<DrawablePoint> display_points;
+  /// Ray casting on the CPU, used to export the view
+  SoftwareRenderer software_renderer;
 private:
   int current_slice;
-  
-  void getColor(DrawablePoint point, double alpha);
 };
 
 #endif // GLWIDGET_H
\ No newline at end of file
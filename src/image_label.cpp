@@ -1,5 +1,10 @@
 #include "image_label.h"
 
+#include <cstring>
+
+#include <QPainter>
+#include <QStyle>
+
 ImageLabel::ImageLabel(QWidget *parent) : QLabel(parent) {
   QSizePolicy size_policy;
   size_policy.setVerticalPolicy(QSizePolicy::MinimumExpanding);
@@ -11,19 +16,84 @@ ImageLabel::ImageLabel(QWidget *parent) : QLabel(parent) {
 ImageLabel::~ImageLabel() {}
 
 void ImageLabel::setImg(QImage img) {
+  if (!text().isEmpty())
+    setText(QString());
+  bool same_layout = img.size() == raw_img.size() &&
+                     img.format() == raw_img.format();
   raw_img = img;
-  updateContent();
+  if (!same_layout) {
+    updateContent();
+    return;
+  }
+  updateScaledImage();
+  // Only the pixels covered by the image change
+  update(target_rect);
 }
 
 void ImageLabel::updateContent() {
-  if (raw_img.isNull())
+  QRect old_rect = target_rect;
+  if (raw_img.isNull()) {
+    target_rect = QRect();
+  } else {
+    QSize scaled_size = raw_img.size().scaled(size(), Qt::KeepAspectRatio);
+    target_rect = QStyle::alignedRect(layoutDirection(), alignment(),
+                                      scaled_size, rect());
+  }
+  src_cols.clear();
+  src_lines.clear();
+  scaled_img = QImage();
+  if (raw_img.format() == QImage::Format_Grayscale8 && !target_rect.isEmpty()) {
+    // Nearest neighbor, sampling the source at the center of each pixel
+    int width = target_rect.width();
+    int height = target_rect.height();
+    src_cols.resize(width);
+    src_lines.resize(height);
+    for (int x = 0; x < width; x++) {
+      src_cols[x] = (int)((x + 0.5) * raw_img.width() / width);
+    }
+    for (int y = 0; y < height; y++) {
+      src_lines[y] = (int)((y + 0.5) * raw_img.height() / height);
+    }
+    scaled_img = QImage(width, height, QImage::Format_Grayscale8);
+  }
+  updateScaledImage();
+  update(old_rect.united(target_rect));
+}
+
+void ImageLabel::updateScaledImage() {
+  if (scaled_img.isNull() || raw_img.isNull())
     return;
-  QPixmap tmp_pixmap = QPixmap::fromImage(raw_img);
-  pixmap = tmp_pixmap.scaled(this->size(), Qt::KeepAspectRatio);
-  setPixmap(pixmap);
+  const int *cols = src_cols.data();
+  int width = scaled_img.width();
+  int prev_src_line = -1;
+  for (int y = 0; y < scaled_img.height(); y++) {
+    uchar *dst = scaled_img.scanLine(y);
+    // Magnified images repeat the same source lines
+    if (src_lines[y] == prev_src_line) {
+      memcpy(dst, scaled_img.constScanLine(y - 1), width);
+      continue;
+    }
+    prev_src_line = src_lines[y];
+    const uchar *src = raw_img.constScanLine(src_lines[y]);
+    for (int x = 0; x < width; x++) {
+      dst[x] = src[cols[x]];
+    }
+  }
 }
 
 void ImageLabel::resizeEvent(QResizeEvent *event) {
-  (void)event;
+  QLabel::resizeEvent(event);
   updateContent();
 }
+
+void ImageLabel::paintEvent(QPaintEvent *event) {
+  if (raw_img.isNull() || !text().isEmpty()) {
+    QLabel::paintEvent(event);
+    return;
+  }
+  QPainter painter(this);
+  if (scaled_img.isNull())
+    painter.drawImage(target_rect, raw_img);
+  else
+    painter.drawImage(target_rect.topLeft(), scaled_img);
+}
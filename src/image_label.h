@@ -3,21 +3,42 @@
 
 #include <QLabel>
 
+#include <vector>
+
+/// A label showing an image scaled to its size, keeping the aspect ratio
+///
+/// The scaling is cached per widget size: the source pixel of each scaled
+/// pixel and the scaled buffer are only computed when the size of the
+/// widget or of the image changes. Showing a new 8-bit image then only
+/// copies its pixels into the scaled buffer, no pixmap is built.
 class ImageLabel : public QLabel {
   Q_OBJECT
 public:
   ImageLabel(QWidget *parent = 0);
   ~ImageLabel();
 
+  /// Show 'img', replacing any text. The image is shared, not copied, and
+  /// may wrap a buffer owned by someone else.
   void setImg(QImage img);
   void updateContent();
 
 protected slots:
   void resizeEvent(QResizeEvent *event) override;
+  void paintEvent(QPaintEvent *event) override;
 
 private:
   QImage raw_img;
-  QPixmap pixmap;
+  /// The area of the widget covered by raw_img
+  QRect target_rect;
+  /// raw_img scaled to target_rect, null for formats other than Grayscale8
+  QImage scaled_img;
+  /// The column and the line of raw_img used for each column and each line
+  /// of scaled_img
+  std::vector<int> src_cols;
+  std::vector<int> src_lines;
+
+  /// Fill scaled_img from raw_img using src_cols and src_lines
+  void updateScaledImage();
 };
 
 #endif // IMAGE_LABEL_H
@@ -0,0 +1,73 @@
+#include "latest_job.h"
+
+#include "thread_pool.h"
+
+LatestJob::LatestJob(QObject *parent)
+    : QObject(parent), latest_id(0), running(false) {}
+
+LatestJob::~LatestJob() {
+  cancel();
+  wait();
+}
+
+void LatestJob::start(Work work, Done done) {
+  latest_id++;
+  Job job{std::move(work), std::move(done), latest_id,
+          std::make_shared<std::atomic<bool>>(false)};
+  std::lock_guard<std::mutex> lock(mutex);
+  if (running) {
+    running_cancelled->store(true);
+    waiting.reset(new Job(std::move(job)));
+    return;
+  }
+  launch(job);
+}
+
+void LatestJob::cancel() {
+  latest_id++;
+  std::lock_guard<std::mutex> lock(mutex);
+  waiting.reset();
+  if (running)
+    running_cancelled->store(true);
+}
+
+void LatestJob::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle_cond.wait(lock, [this]() { return !running; });
+}
+
+bool LatestJob::isBusy() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return running || waiting;
+}
+
+void LatestJob::launch(const Job &job) {
+  running = true;
+  running_cancelled = job.cancelled;
+  ThreadPool::getInstance().submit([this, job]() { run(job); });
+}
+
+void LatestJob::run(Job job) {
+  bool completed = job.work(*job.cancelled);
+  if (completed && !job.cancelled->load()) {
+    // The job might still be superseded before the event is processed
+    int id = job.id;
+    Done done = std::move(job.done);
+    QMetaObject::invokeMethod(
+        this,
+        [this, id, done]() {
+          if (id == latest_id)
+            done();
+        },
+        Qt::QueuedConnection);
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  if (waiting) {
+    Job next = std::move(*waiting);
+    waiting.reset();
+    launch(next);
+  } else {
+    running = false;
+    idle_cond.notify_all();
+  }
+}
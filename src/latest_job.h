@@ -0,0 +1,73 @@
+#ifndef LATEST_JOB_H
+#define LATEST_JOB_H
+
+#include <QObject>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/// Run the most recent of a series of computations on the ThreadPool
+///
+/// Starting a job supersedes the previous ones: the running job sees its
+/// cancellation flag set and its result is dropped, a job waiting for its
+/// turn is replaced. A burst of requests, such as the moves of a slider,
+/// therefore only computes the running request and the last one.
+///
+/// The completion callback of the latest job is called on the thread of the
+/// LatestJob through its event loop, so it can update the widgets.
+class LatestJob : public QObject {
+  Q_OBJECT
+public:
+  /// The computation, run on a worker thread. It must not interact with the
+  /// widgets and should return false as soon as possible once 'cancelled'
+  /// is set.
+  typedef std::function<bool(const std::atomic<bool> &cancelled)> Work;
+  /// Called on the thread of the LatestJob once the work completed
+  typedef std::function<void()> Done;
+
+  explicit LatestJob(QObject *parent = 0);
+  /// Cancel the jobs and wait for the running one to return
+  ~LatestJob();
+
+  /// Supersede the current jobs with a new one
+  void start(Work work, Done done);
+  /// Cancel the running and the waiting jobs, none of them will complete
+  void cancel();
+  /// Wait for the running job to return, e.g. after cancel() before
+  /// modifying the data it reads
+  void wait();
+
+  /// True while a job is running or waiting
+  bool isBusy() const;
+
+private:
+  struct Job {
+    Work work;
+    Done done;
+    int id;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+  };
+
+  /// Identifier of the latest job, only this one can complete. Only used
+  /// from the thread of the LatestJob.
+  int latest_id;
+
+  /// Protects the members below, shared with the worker running the job
+  mutable std::mutex mutex;
+  std::condition_variable idle_cond;
+  bool running;
+  /// Cancellation flag of the running job
+  std::shared_ptr<std::atomic<bool>> running_cancelled;
+  /// The job to run once the running one returns
+  std::unique_ptr<Job> waiting;
+
+  /// Submit 'job' to the ThreadPool, the mutex has to be locked
+  void launch(const Job &job);
+  /// Body of the task running 'job' and the waiting job after it
+  void run(Job job);
+};
+
+#endif // LATEST_JOB_H
@@ -1,8 +1,19 @@
 #include "dicom_viewer.h"
+#include "render_command.h"
 #include <QApplication>
 
+#include <cstring>
+
 int main(int argc, char *argv[])
 {
+    // Rendering from the command line does not require a display
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--render") == 0) {
+            QCoreApplication a(argc, argv);
+            return runRenderCommand(a.arguments());
+        }
+    }
+
     QApplication a(argc, argv);
     DicomViewer w;
     w.show();
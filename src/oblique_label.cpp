@@ -0,0 +1,24 @@
+#include "oblique_label.h"
+
+#include <QMouseEvent>
+#include <QWheelEvent>
+
+ObliqueLabel::ObliqueLabel(QWidget *parent) : ImageLabel(parent) {}
+
+void ObliqueLabel::mousePressEvent(QMouseEvent *event) {
+  last_pos = event->pos();
+}
+
+void ObliqueLabel::mouseMoveEvent(QMouseEvent *event) {
+  if (event->buttons() & Qt::LeftButton) {
+    emit rotationRequested(event->x() - last_pos.x(),
+                           event->y() - last_pos.y());
+  }
+  last_pos = event->pos();
+}
+
+void ObliqueLabel::wheelEvent(QWheelEvent *event) {
+  int steps = event->delta() / 120;
+  if (steps != 0)
+    emit translationRequested(steps);
+}
@@ -0,0 +1,31 @@
+#ifndef OBLIQUE_LABEL_H
+#define OBLIQUE_LABEL_H
+
+#include <QPoint>
+
+#include "image_label.h"
+
+/// An ImageLabel reporting the mouse interactions used to orient a plane
+/// - Dragging with the left button rotates the plane
+/// - The wheel moves the plane along its normal
+class ObliqueLabel : public ImageLabel {
+  Q_OBJECT
+public:
+  ObliqueLabel(QWidget *parent = 0);
+
+signals:
+  /// The mouse was dragged by (dx, dy) pixels
+  void rotationRequested(int dx, int dy);
+  /// The wheel was turned by 'steps' notches
+  void translationRequested(int steps);
+
+protected:
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+  void wheelEvent(QWheelEvent *event) override;
+
+private:
+  QPoint last_pos;
+};
+
+#endif // OBLIQUE_LABEL_H
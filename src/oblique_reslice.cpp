@@ -0,0 +1,233 @@
+#include "oblique_reslice.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "thread_pool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBLIQUE_RESLICE_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+/// The volume and the plane in voxel coordinates, as used by the kernels
+struct ResliceParams {
+  const int16_t *data;
+  int width;
+  int height;
+  int depth;
+  /// Offsets from a voxel to its neighbors, 0 along dimensions of size 1
+  int x_step;
+  int y_step;
+  int z_step;
+  /// Displacement between two consecutive pixels of a row [voxels]
+  float u[3];
+  int16_t outside_value;
+};
+
+/// Compute the pixels [first, count) of a row starting at 'start' (voxel
+/// coordinates)
+typedef void (*ResliceKernel)(const ResliceParams &params, const float *start,
+                              int first, int count, int16_t *dst);
+
+void resliceScalar(const ResliceParams &params, const float *start, int first,
+                   int count, int16_t *dst) {
+  int max_x0 = std::max(params.width - 2, 0);
+  int max_y0 = std::max(params.height - 2, 0);
+  int max_z0 = std::max(params.depth - 2, 0);
+  float max_x = params.width - 1;
+  float max_y = params.height - 1;
+  float max_z = params.depth - 1;
+  for (int i = first; i < count; i++) {
+    float x = start[0] + (float)i * params.u[0];
+    float y = start[1] + (float)i * params.u[1];
+    float z = start[2] + (float)i * params.u[2];
+    if (!(x >= 0 && x <= max_x && y >= 0 && y <= max_y && z >= 0 &&
+          z <= max_z)) {
+      dst[i] = params.outside_value;
+      continue;
+    }
+    // The last voxels are interpolated from the previous ones with a weight
+    // of 1 for the last
+    int x0 = std::min((int)x, max_x0);
+    int y0 = std::min((int)y, max_y0);
+    int z0 = std::min((int)z, max_z0);
+    float fx = x - x0;
+    float fy = y - y0;
+    float fz = z - z0;
+    const int16_t *p = params.data +
+                       ((size_t)z0 * params.height + y0) * params.width + x0;
+    int dx = params.x_step;
+    int dy = params.y_step;
+    int dz = params.z_step;
+    float c00 = p[0] + fx * (float)(p[dx] - p[0]);
+    float c10 = p[dy] + fx * (float)(p[dy + dx] - p[dy]);
+    float c01 = p[dz] + fx * (float)(p[dz + dx] - p[dz]);
+    float c11 = p[dz + dy] + fx * (float)(p[dz + dy + dx] - p[dz + dy]);
+    float c0 = c00 + fy * (c10 - c00);
+    float c1 = c01 + fy * (c11 - c01);
+    dst[i] = (int16_t)std::floor(c0 + fz * (c1 - c0) + 0.5f);
+  }
+}
+
+#ifdef OBLIQUE_RESLICE_X86
+/// Split 8 pairs of consecutive 16-bit values read as 32-bit integers
+__attribute__((target("avx2"))) inline void
+splitPairsAVX2(__m256i pairs, __m256 *first, __m256 *second) {
+  *first = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pairs, 16),
+                                                16));
+  *second = _mm256_cvtepi32_ps(_mm256_srai_epi32(pairs, 16));
+}
+
+/// Interpolation along x of the pairs starting at 'idx'
+__attribute__((target("avx2"))) inline __m256
+lerpPairsAVX2(const int16_t *data, __m256i idx, __m256 fx) {
+  // Each 32-bit gather reads the voxel and its neighbor along x
+  __m256i pairs = _mm256_i32gather_epi32((const int *)data, idx, 2);
+  __m256 a, b;
+  splitPairsAVX2(pairs, &a, &b);
+  return _mm256_add_ps(a, _mm256_mul_ps(fx, _mm256_sub_ps(b, a)));
+}
+
+/// Requires width >= 2 and less than 2^31 voxels
+__attribute__((target("avx2"))) void
+resliceAVX2(const ResliceParams &params, const float *start, int first,
+            int count, int16_t *dst) {
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 max_x = _mm256_set1_ps(params.width - 1);
+  const __m256 max_y = _mm256_set1_ps(params.height - 1);
+  const __m256 max_z = _mm256_set1_ps(params.depth - 1);
+  const __m256i max_x0 = _mm256_set1_epi32(params.width - 2);
+  const __m256i max_y0 = _mm256_set1_epi32(std::max(params.height - 2, 0));
+  const __m256i max_z0 = _mm256_set1_epi32(std::max(params.depth - 2, 0));
+  const __m256i row_size = _mm256_set1_epi32(params.width);
+  const __m256i layer_size = _mm256_set1_epi32(params.width * params.height);
+  const __m256i dy = _mm256_set1_epi32(params.y_step);
+  const __m256i dz = _mm256_set1_epi32(params.z_step);
+  const __m256i outside = _mm256_set1_epi32(params.outside_value);
+  int i = first;
+  for (; i + 8 <= count; i += 8) {
+    __m256 fi = _mm256_add_ps(_mm256_set1_ps((float)i), lanes);
+    __m256 x = _mm256_add_ps(_mm256_set1_ps(start[0]),
+                             _mm256_mul_ps(fi, _mm256_set1_ps(params.u[0])));
+    __m256 y = _mm256_add_ps(_mm256_set1_ps(start[1]),
+                             _mm256_mul_ps(fi, _mm256_set1_ps(params.u[1])));
+    __m256 z = _mm256_add_ps(_mm256_set1_ps(start[2]),
+                             _mm256_mul_ps(fi, _mm256_set1_ps(params.u[2])));
+    __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+                      _mm256_cmp_ps(x, max_x, _CMP_LE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ),
+                      _mm256_cmp_ps(y, max_y, _CMP_LE_OQ)));
+    inside = _mm256_and_ps(
+        inside, _mm256_and_ps(_mm256_cmp_ps(z, zero, _CMP_GE_OQ),
+                              _mm256_cmp_ps(z, max_z, _CMP_LE_OQ)));
+    if (_mm256_movemask_ps(inside) == 0) {
+      _mm_storeu_si128((__m128i *)(dst + i),
+                       _mm_set1_epi16(params.outside_value));
+      continue;
+    }
+    // Clamping keeps the gathers inside of the volume for outside pixels
+    x = _mm256_min_ps(_mm256_max_ps(x, zero), max_x);
+    y = _mm256_min_ps(_mm256_max_ps(y, zero), max_y);
+    z = _mm256_min_ps(_mm256_max_ps(z, zero), max_z);
+    __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(x), max_x0);
+    __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(y), max_y0);
+    __m256i z0 = _mm256_min_epi32(_mm256_cvttps_epi32(z), max_z0);
+    __m256 fx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+    __m256 fy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+    __m256 fz = _mm256_sub_ps(z, _mm256_cvtepi32_ps(z0));
+    __m256i idx = _mm256_add_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(z0, layer_size),
+                         _mm256_mullo_epi32(y0, row_size)),
+        x0);
+    __m256 c00 = lerpPairsAVX2(params.data, idx, fx);
+    __m256 c10 = lerpPairsAVX2(params.data, _mm256_add_epi32(idx, dy), fx);
+    __m256 c01 = lerpPairsAVX2(params.data, _mm256_add_epi32(idx, dz), fx);
+    __m256 c11 = lerpPairsAVX2(
+        params.data, _mm256_add_epi32(idx, _mm256_add_epi32(dy, dz)), fx);
+    __m256 c0 = _mm256_add_ps(c00, _mm256_mul_ps(fy, _mm256_sub_ps(c10, c00)));
+    __m256 c1 = _mm256_add_ps(c01, _mm256_mul_ps(fy, _mm256_sub_ps(c11, c01)));
+    __m256 value = _mm256_add_ps(c0, _mm256_mul_ps(fz, _mm256_sub_ps(c1, c0)));
+    __m256i result = _mm256_cvttps_epi32(
+        _mm256_floor_ps(_mm256_add_ps(value, _mm256_set1_ps(0.5f))));
+    result = _mm256_blendv_epi8(outside, result, _mm256_castps_si256(inside));
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_packs_epi32(_mm256_castsi256_si128(result),
+                                     _mm256_extracti128_si256(result, 1)));
+  }
+  resliceScalar(params, start, i, count, dst);
+}
+#endif
+
+struct KernelChoice {
+  ResliceKernel kernel;
+  const char *name;
+};
+
+KernelChoice chooseKernel() {
+#ifdef OBLIQUE_RESLICE_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {resliceAVX2, "AVX2"};
+#endif
+  return {resliceScalar, "scalar"};
+}
+
+const KernelChoice &getKernel() {
+  static const KernelChoice choice = chooseKernel();
+  return choice;
+}
+} // namespace
+
+void reslice(const RawData &volume, const ObliquePlane &plane, int width,
+             int height, int16_t *dst, int16_t outside_value) {
+  if (width <= 0 || height <= 0)
+    return;
+  size_t nb_voxels = (size_t)volume.width * volume.height * volume.depth;
+  if (nb_voxels == 0 || volume.size() < nb_voxels) {
+    std::fill(dst, dst + (size_t)width * height, outside_value);
+    return;
+  }
+  ResliceParams params;
+  params.data = volume.data();
+  params.width = volume.width;
+  params.height = volume.height;
+  params.depth = volume.depth;
+  params.x_step = volume.width > 1 ? 1 : 0;
+  params.y_step = volume.height > 1 ? volume.width : 0;
+  params.z_step = volume.depth > 1 ? volume.width * volume.height : 0;
+  params.outside_value = outside_value;
+  // Conversion from mm to voxels, a single layer has no spacing
+  double voxel_size[3] = {volume.pixel_width, volume.pixel_height,
+                          std::fabs(volume.slice_spacing)};
+  for (int axis = 0; axis < 3; axis++) {
+    if (voxel_size[axis] <= 0)
+      voxel_size[axis] = 1;
+  }
+  double center[3], u[3], v[3];
+  for (int axis = 0; axis < 3; axis++) {
+    center[axis] = plane.center[axis] / voxel_size[axis];
+    u[axis] = plane.u[axis] / voxel_size[axis];
+    v[axis] = plane.v[axis] / voxel_size[axis];
+    params.u[axis] = u[axis];
+  }
+  // The gathers use 32-bit offsets and read pairs of voxels along x
+  ResliceKernel kernel = getKernel().kernel;
+  if (volume.width < 2 || nb_voxels >= (size_t)1 << 31)
+    kernel = resliceScalar;
+  ThreadPool::getInstance().parallelFor(0, height, [&](int row) {
+    // Pixels are centered on the plane center
+    double du = -(width - 1) / 2.0;
+    double dv = row - (height - 1) / 2.0;
+    float start[3];
+    for (int axis = 0; axis < 3; axis++) {
+      start[axis] = center[axis] + du * u[axis] + dv * v[axis];
+    }
+    kernel(params, start, 0, width, dst + (size_t)row * width);
+  });
+}
+
+const char *getResliceKernelName() { return getKernel().name; }
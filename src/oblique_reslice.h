@@ -0,0 +1,36 @@
+#ifndef OBLIQUE_RESLICE_H
+#define OBLIQUE_RESLICE_H
+
+#include <cstdint>
+#include <limits>
+
+#include "raw_data.h"
+
+/// A plane crossing a volume, in mm in the frame of the volume: the voxel
+/// (col, row, layer) is at (col * pixel_width, row * pixel_height,
+/// layer * |slice_spacing|)
+struct ObliquePlane {
+  /// Position of the center of the image [mm]
+  double center[3];
+  /// Displacement between two consecutive columns of the image [mm]
+  double u[3];
+  /// Displacement between two consecutive rows of the image [mm]
+  double v[3];
+};
+
+/// Sample the modality values of 'volume' on 'plane' with trilinear
+/// interpolation. 'dst' receives width*height values stored line by line,
+/// pixels outside of the volume receive 'outside_value'. Values are rounded
+/// to the closest integer.
+///
+/// Rows are processed in parallel on the ThreadPool. The fastest
+/// implementation supported by the CPU (AVX2 gathers or scalar) is chosen on
+/// first call, both produce exactly the same values.
+void reslice(const RawData &volume, const ObliquePlane &plane, int width,
+             int height, int16_t *dst,
+             int16_t outside_value = std::numeric_limits<int16_t>::min());
+
+/// Name of the implementation used by reslice, for diagnostic purpose
+const char *getResliceKernelName();
+
+#endif // OBLIQUE_RESLICE_H
@@ -0,0 +1,370 @@
+#include "paged_volume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <QDir>
+#include <QStandardPaths>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "brick_packing.h"
+#include "thread_pool.h"
+
+namespace {
+/// Size of a brick in the file and in memory [bytes]
+const size_t brick_bytes =
+    sizeof(int16_t) * PagedVolume::BRICK_SIZE * PagedVolume::BRICK_SIZE *
+    PagedVolume::BRICK_SIZE;
+
+/// Number of voxels of a preview along an axis of 'size' voxels
+int getPreviewSize(int size, int factor) {
+  return (size + factor - 1) / factor;
+}
+} // namespace
+
+PagedVolume::PagedVolume()
+    : width(-1), height(-1), depth(-1), pixel_width(-1), pixel_height(-1),
+      slice_spacing(0), bricks_x(0), bricks_y(0), bricks_z(0), storage(DISK),
+      zero_brick(std::make_shared<Brick>((size_t)BRICK_VOXELS)),
+      memory_budget(0), packed_size(0), write_error(false) {}
+
+bool PagedVolume::create(int W, int H, int D, size_t new_memory_budget,
+                         Storage new_storage) {
+  std::unique_ptr<QTemporaryFile> new_file;
+  if (new_storage == DISK) {
+    // The file goes to the cache location of the user, the temporary
+    // directory is often held in memory
+    QString location =
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!QDir().mkpath(location))
+      return false;
+    new_file.reset(
+        new QTemporaryFile(QDir(location).filePath("paged_XXXXXX.bricks")));
+    if (!new_file->open())
+      return false;
+  }
+  const int brick_size = BRICK_SIZE;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::lock_guard<std::mutex> file_lock(file_mutex);
+  width = W;
+  height = H;
+  depth = D;
+  bricks_x = (W + brick_size - 1) / brick_size;
+  bricks_y = (H + brick_size - 1) / brick_size;
+  bricks_z = (D + brick_size - 1) / brick_size;
+  storage = new_storage;
+  memory_budget = new_memory_budget;
+  file = std::move(new_file);
+  // The file grows as bricks are written back, the others are never read
+  size_t nb_bricks = (size_t)bricks_x * bricks_y * bricks_z;
+  stored.assign(nb_bricks, false);
+  stored_versions.assign(nb_bricks, 0);
+  packed.assign(storage == PACKED ? nb_bricks : 0, nullptr);
+  packed_size = 0;
+  write_error = false;
+  lru.clear();
+  entries.clear();
+  return true;
+}
+
+size_t PagedVolume::getDefaultMemoryBudget() {
+#if defined(Q_OS_UNIX) && defined(_SC_PHYS_PAGES)
+  long nb_pages = sysconf(_SC_PHYS_PAGES);
+  long page_size = sysconf(_SC_PAGE_SIZE);
+  if (nb_pages > 0 && page_size > 0)
+    return (size_t)nb_pages * page_size / 2;
+#endif
+  // The physical memory is unknown
+  return (size_t)4 << 30;
+}
+
+void PagedVolume::setMemoryBudget(size_t new_memory_budget) {
+  std::lock_guard<std::mutex> lock(mutex);
+  memory_budget = new_memory_budget;
+  evict();
+}
+
+size_t PagedVolume::getMemoryBudget() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return memory_budget;
+}
+
+size_t PagedVolume::getMemoryUsage() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size() * brick_bytes;
+}
+
+bool PagedVolume::hasWriteError() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return write_error;
+}
+
+size_t PagedVolume::getPackedSize() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return packed_size;
+}
+
+size_t PagedVolume::getBrickLayerSize() const {
+  return (size_t)bricks_x * bricks_y * brick_bytes;
+}
+
+std::shared_ptr<const PagedVolume::Brick>
+PagedVolume::getBrick(int bx, int by, int bz) const {
+  return getBrick(getBrickIndex(bx, by, bz));
+}
+
+std::shared_ptr<const PagedVolume::Brick>
+PagedVolume::getBrick(size_t brick_idx) const {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (entries.count(brick_idx) == 0 && !stored[brick_idx])
+    return zero_brick;
+  std::shared_ptr<const Brick> brick = acquire(brick_idx, &lock).brick;
+  evict();
+  return brick;
+}
+
+int16_t PagedVolume::getValue(int col, int row, int layer) const {
+  std::shared_ptr<const Brick> brick = getBrick(
+      col >> BRICK_SHIFT, row >> BRICK_SHIFT, layer >> BRICK_SHIFT);
+  return (*brick)[getVoxelIndex(col, row, layer)];
+}
+
+void PagedVolume::copyRegion(int x, int y, int z, int w, int h, int d,
+                             int16_t *dst) const {
+  if (x < 0 || y < 0 || z < 0 || w < 0 || h < 0 || d < 0 ||
+      x + w > width || y + h > height || z + d > depth)
+    throw std::out_of_range("Region is outside of volume");
+  if (w == 0 || h == 0 || d == 0)
+    return;
+  const int brick_size = BRICK_SIZE;
+  for (int bz = z >> BRICK_SHIFT; bz <= (z + d - 1) >> BRICK_SHIFT; bz++) {
+    int z_begin = std::max(z, bz * brick_size);
+    int z_end = std::min(z + d, (bz + 1) * brick_size);
+    for (int by = y >> BRICK_SHIFT; by <= (y + h - 1) >> BRICK_SHIFT; by++) {
+      int y_begin = std::max(y, by * brick_size);
+      int y_end = std::min(y + h, (by + 1) * brick_size);
+      for (int bx = x >> BRICK_SHIFT; bx <= (x + w - 1) >> BRICK_SHIFT;
+           bx++) {
+        int x_begin = std::max(x, bx * brick_size);
+        int count = std::min(x + w, (bx + 1) * brick_size) - x_begin;
+        std::shared_ptr<const Brick> brick = getBrick(bx, by, bz);
+        for (int vz = z_begin; vz < z_end; vz++) {
+          for (int vy = y_begin; vy < y_end; vy++) {
+            size_t dst_idx = ((size_t)(vz - z) * h + (vy - y)) * w +
+                             (x_begin - x);
+            std::memcpy(dst + dst_idx,
+                        brick->data() + getVoxelIndex(x_begin, vy, vz),
+                        count * sizeof(int16_t));
+          }
+        }
+      }
+    }
+  }
+}
+
+void PagedVolume::setLayer(const int16_t *layer_data, int layer) {
+  if (layer < 0 || layer >= depth)
+    throw std::out_of_range(
+        "Layer " + std::to_string(layer) +
+        " is outside of volume (depth=" + std::to_string(depth) + ")");
+  const int brick_size = BRICK_SIZE;
+  int bz = layer >> BRICK_SHIFT;
+  std::unique_lock<std::mutex> lock(mutex);
+  for (int by = 0; by < bricks_y; by++) {
+    int y_end = std::min((by + 1) * brick_size, height);
+    for (int bx = 0; bx < bricks_x; bx++) {
+      int x = bx * brick_size;
+      int count = std::min(brick_size, width - x);
+      Entry &entry = acquire(getBrickIndex(bx, by, bz), &lock);
+      // Readers holding the brick keep their values, the brick is copied.
+      // They only get new pointers to it with the mutex locked.
+      if (entry.brick.use_count() > 1)
+        entry.brick = std::make_shared<Brick>(*entry.brick);
+      for (int y = by * brick_size; y < y_end; y++) {
+        std::memcpy(entry.brick->data() + getVoxelIndex(x, y, layer),
+                    layer_data + (size_t)y * width + x,
+                    count * sizeof(int16_t));
+      }
+      entry.dirty = true;
+      // Only the brick being written may exceed the budget
+      evict();
+    }
+  }
+}
+
+int PagedVolume::getPreviewFactor(size_t max_bytes) const {
+  int max_size = std::max(width, std::max(height, depth));
+  for (int factor = 1; factor < max_size; factor++) {
+    size_t nb_values = (size_t)getPreviewSize(width, factor) *
+                       getPreviewSize(height, factor) *
+                       getPreviewSize(depth, factor);
+    if (nb_values * sizeof(int16_t) <= max_bytes)
+      return factor;
+  }
+  // A single voxel
+  return std::max(max_size, 1);
+}
+
+std::shared_ptr<RawData> PagedVolume::createPreview(int factor) const {
+  std::shared_ptr<RawData> preview = std::make_shared<RawData>(
+      getPreviewSize(width, factor), getPreviewSize(height, factor),
+      getPreviewSize(depth, factor));
+  preview->pixel_width = pixel_width * factor;
+  preview->pixel_height = pixel_height * factor;
+  preview->slice_spacing = slice_spacing * factor;
+  return preview;
+}
+
+void PagedVolume::downsampleLayers(int factor, int first_layer,
+                                   int last_layer, RawData *preview) const {
+  first_layer = std::max(first_layer, 0);
+  last_layer = std::min(last_layer, preview->depth - 1);
+  int out_W = preview->width;
+  int out_H = preview->height;
+  ThreadPool::getInstance().parallelFor(
+      first_layer, last_layer + 1, [&](int out_z) {
+        // Layers are read one by one, their values are summed per voxel of
+        // the preview
+        std::vector<int16_t> layer((size_t)width * height);
+        std::vector<int64_t> sums(preview->getLayerSize(), 0);
+        int z_end = std::min((out_z + 1) * factor, depth);
+        for (int z = out_z * factor; z < z_end; z++) {
+          copyRegion(0, 0, z, width, height, 1, layer.data());
+          for (int y = 0; y < height; y++) {
+            const int16_t *row = layer.data() + (size_t)y * width;
+            int64_t *line = sums.data() + (size_t)(y / factor) * out_W;
+            for (int x = 0; x < width; x++) {
+              line[x / factor] += row[x];
+            }
+          }
+        }
+        int nb_z = z_end - out_z * factor;
+        int16_t *dst = preview->getLayer(out_z);
+        for (int out_y = 0; out_y < out_H; out_y++) {
+          int nb_y = std::min((out_y + 1) * factor, height) - out_y * factor;
+          size_t out_line = (size_t)out_y * out_W;
+          for (int out_x = 0; out_x < out_W; out_x++) {
+            int nb_x = std::min((out_x + 1) * factor, width) - out_x * factor;
+            double mean =
+                sums[out_line + out_x] / (double)(nb_x * nb_y * nb_z);
+            dst[out_line + out_x] = (int16_t)std::floor(mean + 0.5);
+          }
+        }
+      });
+}
+
+PagedVolume::Entry &
+PagedVolume::acquire(size_t brick_idx,
+                     std::unique_lock<std::mutex> *lock) const {
+  // Stored bricks are read or unpacked without the lock, unless they are
+  // stored again meanwhile
+  while (entries.count(brick_idx) == 0 && stored[brick_idx]) {
+    uint32_t version = stored_versions[brick_idx];
+    std::shared_ptr<const std::vector<uint8_t>> source;
+    if (storage == PACKED)
+      source = packed[brick_idx];
+    lock->unlock();
+    std::shared_ptr<Brick> brick = load(brick_idx, source.get());
+    lock->lock();
+    if (entries.count(brick_idx) == 0 &&
+        stored_versions[brick_idx] == version)
+      return insert(brick_idx, std::move(brick));
+  }
+  auto it = entries.find(brick_idx);
+  if (it != entries.end()) {
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    return it->second;
+  }
+  // A brick never stored only holds 0
+  return insert(brick_idx, std::make_shared<Brick>((size_t)BRICK_VOXELS));
+}
+
+std::shared_ptr<PagedVolume::Brick>
+PagedVolume::load(size_t brick_idx,
+                  const std::vector<uint8_t> *packed_values) const {
+  std::shared_ptr<Brick> brick = std::make_shared<Brick>((size_t)BRICK_VOXELS);
+  if (packed_values) {
+    unpackValues(packed_values->data(), BRICK_VOXELS, brick->data());
+    return brick;
+  }
+  char *bytes = reinterpret_cast<char *>(brick->data());
+  std::lock_guard<std::mutex> file_lock(file_mutex);
+  // A brick which can't be read is left empty
+  if (!file->seek((qint64)(brick_idx * brick_bytes)) ||
+      file->read(bytes, brick_bytes) != (qint64)brick_bytes)
+    std::fill(brick->begin(), brick->end(), 0);
+  return brick;
+}
+
+PagedVolume::Entry &PagedVolume::insert(size_t brick_idx,
+                                        std::shared_ptr<Brick> brick) const {
+  lru.push_front(brick_idx);
+  Entry &entry = entries[brick_idx];
+  entry.brick = std::move(brick);
+  entry.lru_pos = lru.begin();
+  entry.dirty = false;
+  return entry;
+}
+
+void PagedVolume::evict() const {
+  while (entries.size() * brick_bytes > memory_budget && !lru.empty()) {
+    size_t brick_idx = lru.back();
+    Entry &entry = entries.at(brick_idx);
+    if (entry.dirty && storage == PACKED) {
+      std::shared_ptr<std::vector<uint8_t>> values =
+          std::make_shared<std::vector<uint8_t>>();
+      packValues(entry.brick->data(), BRICK_VOXELS, values.get());
+      values->shrink_to_fit();
+      if (packed[brick_idx])
+        packed_size -= packed[brick_idx]->size();
+      packed_size += values->size();
+      packed[brick_idx] = std::move(values);
+      stored[brick_idx] = true;
+      stored_versions[brick_idx]++;
+    } else if (entry.dirty) {
+      const char *bytes = reinterpret_cast<const char *>(entry.brick->data());
+      std::lock_guard<std::mutex> file_lock(file_mutex);
+      if (!file->seek((qint64)(brick_idx * brick_bytes)) ||
+          file->write(bytes, brick_bytes) != (qint64)brick_bytes) {
+        write_error = true;
+        return;
+      }
+      stored[brick_idx] = true;
+      stored_versions[brick_idx]++;
+    }
+    entries.erase(brick_idx);
+    lru.pop_back();
+  }
+}
+
+PagedVolume::Reader::Reader(const PagedVolume &volume)
+    : width(volume.width), height(volume.height), depth(volume.depth),
+      volume(&volume), last_slot(0), next_slot(0) {
+  for (int slot = 0; slot < NB_SLOTS; slot++) {
+    slot_bricks[slot] = std::numeric_limits<size_t>::max();
+    slot_values[slot] = nullptr;
+  }
+}
+
+void PagedVolume::Reader::useSlot(size_t brick_idx) const {
+  for (int slot = 0; slot < NB_SLOTS; slot++) {
+    if (slot_bricks[slot] == brick_idx) {
+      last_slot = slot;
+      return;
+    }
+  }
+  // Replacing the slots in turn, neighbouring bricks are used together
+  int slot = next_slot;
+  next_slot = (next_slot + 1) % NB_SLOTS;
+  slots[slot] = volume->getBrick(brick_idx);
+  slot_bricks[slot] = brick_idx;
+  slot_values[slot] = slots[slot]->data();
+  last_slot = slot;
+}
@@ -0,0 +1,227 @@
+#ifndef PAGED_VOLUME_H
+#define PAGED_VOLUME_H
+
+#include <QTemporaryFile>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "raw_data.h"
+
+/// The modality values of a volume stored in bricks which are loaded on
+/// demand, either from a temporary file for volumes too large for memory, or
+/// packed in memory to reduce the size of resident volumes
+///
+/// Bricks of BRICK_SIZE^3 values are stored one after the other, column by
+/// column, line by line, then slice by slice, and so are the values inside
+/// each brick. The bricks used recently stay in memory: once their size
+/// exceeds the memory budget, the least recently used ones are released,
+/// modified bricks being written back or packed first. Readers only load
+/// the bricks they touch, bricks never written are not stored at all.
+/// Packed bricks are unpacked by the threads reading them, in parallel.
+///
+/// The bricks in memory are a cache: reading values is a const operation
+/// even if it loads bricks. All the methods can be called from any thread.
+class PagedVolume {
+public:
+  /// log2 of the side of the bricks
+  static const int BRICK_SHIFT = 5;
+  /// Side of the bricks [voxels], a brick holds 64 KiB
+  static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+  static const int BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+  typedef std::vector<int16_t> Brick;
+
+  /// Where the bricks released from memory are kept
+  enum Storage {
+    /// In a temporary file in the cache location
+    DISK,
+    /// In memory, packed by packValues (see brick_packing.h)
+    PACKED
+  };
+
+  int width;
+  int height;
+  int depth;
+  /// The size of the voxels [mm]
+  double pixel_width;
+  double pixel_height;
+  double slice_spacing;
+
+  /// An empty volume
+  PagedVolume();
+  PagedVolume(const PagedVolume &other) = delete;
+  PagedVolume &operator=(const PagedVolume &other) = delete;
+
+  /// Create a volume of 'width' * 'height' * 'depth' values set to 0,
+  /// keeping at most 'memory_budget' bytes of unpacked bricks in memory.
+  /// Return false if the file of DISK storage can't be created, it is
+  /// removed with the volume.
+  bool create(int width, int height, int depth, size_t memory_budget,
+              Storage storage = DISK);
+  Storage getStorage() const { return storage; }
+
+  /// Half of the physical memory, the budget used when none is chosen
+  static size_t getDefaultMemoryBudget();
+  /// Change the size of the bricks kept in memory [bytes], releasing bricks
+  /// if needed
+  void setMemoryBudget(size_t memory_budget);
+  size_t getMemoryBudget() const;
+  /// Size of the unpacked bricks currently in memory [bytes]. The bricks
+  /// released while held by a Reader (Reader::NB_SLOTS at most per Reader)
+  /// or through getBrick are not counted, they are freed by their holder.
+  size_t getMemoryUsage() const;
+  /// True once a modified brick could not be written to the file of DISK
+  /// storage. Such bricks stay in memory, beyond the memory budget.
+  bool hasWriteError() const;
+  /// Size of the packed bricks [bytes], 0 for DISK storage
+  size_t getPackedSize() const;
+  /// Size of a layer of bricks [bytes], the bricks modified by setLayer
+  size_t getBrickLayerSize() const;
+
+  bool empty() const { return bricks_x == 0; }
+  /// Number of bricks along each axis
+  int getBricksX() const { return bricks_x; }
+  int getBricksY() const { return bricks_y; }
+  int getBricksZ() const { return bricks_z; }
+
+  /// The BRICK_VOXELS values of the brick at (bx, by, bz), loaded if it is
+  /// not in memory. The values stay valid while the pointer is held, even if
+  /// the brick is released meanwhile.
+  std::shared_ptr<const Brick> getBrick(int bx, int by, int bz) const;
+  /// Read a single value, prefer Reader or copyRegion to read many
+  int16_t getValue(int col, int row, int layer) const;
+
+  /// Copy the 'w' * 'h' * 'd' values starting at voxel (x, y, z) to 'dst',
+  /// column by column, line by line, then slice by slice. Only the bricks
+  /// intersecting the region are read.
+  /// Throws std::out_of_range if the region is not in the volume
+  void copyRegion(int x, int y, int z, int w, int h, int d,
+                  int16_t *dst) const;
+
+  /// Copy the 'width' * 'height' values of 'layer_data' to 'layer'
+  /// Throws std::out_of_range if 'layer' is not in the volume
+  void setLayer(const int16_t *layer_data, int layer);
+
+  /// The smallest factor by which the volume has to be downsampled along
+  /// each axis so that its values fit in 'max_bytes'
+  int getPreviewFactor(size_t max_bytes) const;
+  /// A volume downsampled by 'factor' along each axis, filled with 0. Its
+  /// voxel sizes are scaled accordingly.
+  std::shared_ptr<RawData> createPreview(int factor) const;
+  /// Fill the layers [first_layer, last_layer] of 'preview', created with
+  /// 'factor', with the rounded average of the voxels they cover. Layers are
+  /// processed in parallel on the ThreadPool.
+  void downsampleLayers(int factor, int first_layer, int last_layer,
+                        RawData *preview) const;
+
+  /// Reads the values of a volume from a single thread, keeping the last
+  /// bricks used so that neighbouring values are read without locking
+  class Reader {
+  public:
+    /// Number of bricks kept by a reader
+    static const int NB_SLOTS = 8;
+
+    int width;
+    int height;
+    int depth;
+
+    explicit Reader(const PagedVolume &volume);
+
+    int16_t getValue(int col, int row, int layer) const {
+      size_t brick_idx = volume->getBrickIndex(
+          col >> BRICK_SHIFT, row >> BRICK_SHIFT, layer >> BRICK_SHIFT);
+      if (slot_bricks[last_slot] != brick_idx)
+        useSlot(brick_idx);
+      return slot_values[last_slot][getVoxelIndex(col, row, layer)];
+    }
+
+  private:
+    const PagedVolume *volume;
+    /// The bricks kept, identified by their index in the volume
+    mutable size_t slot_bricks[NB_SLOTS];
+    mutable std::shared_ptr<const Brick> slots[NB_SLOTS];
+    mutable const int16_t *slot_values[NB_SLOTS];
+    /// The slot of the last brick read
+    mutable int last_slot;
+    /// The slot replaced by the next brick loaded
+    mutable int next_slot;
+
+    /// Make 'brick_idx' the last brick read, loading it if needed
+    void useSlot(size_t brick_idx) const;
+  };
+
+private:
+  /// A brick in memory
+  struct Entry {
+    std::shared_ptr<Brick> brick;
+    std::list<size_t>::iterator lru_pos;
+    /// True if the brick was modified since it was written to the file
+    bool dirty;
+  };
+
+  int bricks_x;
+  int bricks_y;
+  int bricks_z;
+  Storage storage;
+  /// Shared by the bricks never written
+  std::shared_ptr<const Brick> zero_brick;
+  /// Protects the position in the file, bricks are read without mutex.
+  /// When both are needed, mutex is locked first.
+  mutable std::mutex file_mutex;
+  std::unique_ptr<QTemporaryFile> file;
+  /// Protects all the members below
+  mutable std::mutex mutex;
+  size_t memory_budget;
+  /// True for the bricks written to the file or packed, the others only
+  /// hold 0
+  mutable std::vector<bool> stored;
+  /// Incremented each time a brick is stored, readers loading a brick
+  /// without the mutex can tell that it changed meanwhile
+  mutable std::vector<uint32_t> stored_versions;
+  /// The values of the bricks stored with PACKED storage. Packing a brick
+  /// again replaces its pointer, readers unpacking the previous one keep it.
+  mutable std::vector<std::shared_ptr<const std::vector<uint8_t>>> packed;
+  mutable size_t packed_size;
+  /// True once a brick could not be written to the file
+  mutable bool write_error;
+  /// Bricks in memory from the most recently used to the least recently used
+  mutable std::list<size_t> lru;
+  mutable std::unordered_map<size_t, Entry> entries;
+
+  size_t getBrickIndex(int bx, int by, int bz) const {
+    return ((size_t)bz * bricks_y + by) * bricks_x + bx;
+  }
+  /// Position of the voxel inside its brick
+  static size_t getVoxelIndex(int col, int row, int layer) {
+    const int mask = BRICK_SIZE - 1;
+    size_t line = ((size_t)(layer & mask) << BRICK_SHIFT) + (row & mask);
+    return (line << BRICK_SHIFT) + (col & mask);
+  }
+
+  /// The values of the brick 'brick_idx', as getBrick
+  std::shared_ptr<const Brick> getBrick(size_t brick_idx) const;
+  /// The brick 'brick_idx' in memory, loaded if needed and marked as most
+  /// recently used. The mutex has to be locked with 'lock', it is released
+  /// while the brick is read or unpacked.
+  Entry &acquire(size_t brick_idx, std::unique_lock<std::mutex> *lock) const;
+  /// The values of the stored brick 'brick_idx', unpacked from
+  /// 'packed_values' with PACKED storage or read from the file. Called
+  /// without the mutex.
+  std::shared_ptr<Brick> load(size_t brick_idx,
+                              const std::vector<uint8_t> *packed_values) const;
+  /// Add 'brick' to the bricks in memory as the most recently used, the
+  /// mutex has to be locked
+  Entry &insert(size_t brick_idx, std::shared_ptr<Brick> brick) const;
+  /// Release the least recently used bricks beyond the budget, bricks which
+  /// can't be written back stay in memory and set write_error. The mutex has
+  /// to be locked.
+  void evict() const;
+};
+
+#endif // PAGED_VOLUME_H
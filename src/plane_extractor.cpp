@@ -0,0 +1,133 @@
+#include "plane_extractor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "thread_pool.h"
+
+PlaneExtractor::PlaneExtractor()
+    : width(0), height(0), depth(0), sagittal_slab_first(-1) {}
+
+void PlaneExtractor::setVolume(std::shared_ptr<const RawData> new_volume) {
+  volume = std::move(new_volume);
+  paged_volume.reset();
+  width = volume ? volume->width : 0;
+  height = volume ? volume->height : 0;
+  depth = volume ? volume->depth : 0;
+  std::vector<int16_t>().swap(paged_plane);
+  std::vector<int16_t>().swap(coronal_plane);
+  std::vector<int16_t>().swap(sagittal_slab);
+  sagittal_slab_first = -1;
+}
+
+void PlaneExtractor::setVolume(std::shared_ptr<const PagedVolume> new_volume) {
+  setVolume(std::shared_ptr<const RawData>());
+  paged_volume = std::move(new_volume);
+  width = paged_volume ? paged_volume->width : 0;
+  height = paged_volume ? paged_volume->height : 0;
+  depth = paged_volume ? paged_volume->depth : 0;
+}
+
+int PlaneExtractor::getNbPlanes(Axis axis) const {
+  if (!volume && !paged_volume)
+    return 0;
+  switch (axis) {
+    case AXIAL:
+      return depth;
+    case CORONAL:
+      return height;
+    case SAGITTAL:
+      return width;
+  }
+  return 0;
+}
+
+void PlaneExtractor::getPlaneSize(Axis axis, int *plane_width,
+                                  int *plane_height) const {
+  *plane_width = 0;
+  *plane_height = 0;
+  if (!volume && !paged_volume)
+    return;
+  switch (axis) {
+    case AXIAL:
+      *plane_width = width;
+      *plane_height = height;
+      break;
+    case CORONAL:
+      *plane_width = width;
+      *plane_height = depth;
+      break;
+    case SAGITTAL:
+      *plane_width = height;
+      *plane_height = depth;
+      break;
+  }
+}
+
+const int16_t *PlaneExtractor::getPlane(Axis axis, int idx) {
+  if (idx < 0 || idx >= getNbPlanes(axis))
+    throw std::out_of_range("Plane " + std::to_string(idx) +
+                            " is outside of volume");
+  int W = width;
+  int H = height;
+  int D = depth;
+  if (paged_volume) {
+    // Each plane is a region one voxel thick, stored line by line
+    int plane_width, plane_height;
+    getPlaneSize(axis, &plane_width, &plane_height);
+    paged_plane.resize((size_t)plane_width * plane_height);
+    int16_t *dst = paged_plane.data();
+    switch (axis) {
+      case AXIAL:
+        paged_volume->copyRegion(0, 0, idx, W, H, 1, dst);
+        break;
+      case CORONAL:
+        paged_volume->copyRegion(0, idx, 0, W, 1, D, dst);
+        break;
+      case SAGITTAL:
+        paged_volume->copyRegion(idx, 0, 0, 1, H, D, dst);
+        break;
+    }
+    return dst;
+  }
+  switch (axis) {
+    case AXIAL:
+      return volume->getLayer(idx);
+    case CORONAL:
+      coronal_plane.resize((size_t)W * D);
+      for (int z = 0; z < D; z++) {
+        std::memcpy(coronal_plane.data() + (size_t)z * W,
+                    volume->getRow(idx, z), W * sizeof(int16_t));
+      }
+      return coronal_plane.data();
+    case SAGITTAL: {
+      int first_plane = idx - idx % SAGITTAL_SLAB_SIZE;
+      if (first_plane != sagittal_slab_first)
+        updateSagittalSlab(first_plane);
+      return sagittal_slab.data() + (size_t)(idx - first_plane) * H * D;
+    }
+  }
+  return nullptr;
+}
+
+void PlaneExtractor::updateSagittalSlab(int first_plane) {
+  int W = width;
+  int H = height;
+  int D = depth;
+  int nb_planes = std::min(SAGITTAL_SLAB_SIZE, W - first_plane);
+  size_t plane_size = (size_t)H * D;
+  sagittal_slab.resize(nb_planes * plane_size);
+  // Each row of the volume is read once for all the planes of the slab
+  ThreadPool::getInstance().parallelFor(0, D, [&](int z) {
+    for (int y = 0; y < H; y++) {
+      const int16_t *row = volume->getRow(y, z) + first_plane;
+      int16_t *dst = sagittal_slab.data() + (size_t)z * H + y;
+      for (int plane = 0; plane < nb_planes; plane++) {
+        dst[plane * plane_size] = row[plane];
+      }
+    }
+  });
+  sagittal_slab_first = first_plane;
+}
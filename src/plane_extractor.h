@@ -0,0 +1,69 @@
+#ifndef PLANE_EXTRACTOR_H
+#define PLANE_EXTRACTOR_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "paged_volume.h"
+#include "raw_data.h"
+
+/// Extract the axis-aligned planes of a volume for multi-planar reformatting
+///
+/// The volume is stored slice by slice, so:
+/// - AXIAL planes (constant layer) are contiguous and returned in place
+/// - CORONAL planes (constant row) are made of one row per layer
+/// - SAGITTAL planes (constant column) read one value per row. Reading them
+///   one by one would use a single value per cache line, so slabs of
+///   consecutive sagittal planes are extracted together and cached.
+///
+/// Planes of a PagedVolume are copied from the bricks they cross, which stay
+/// in memory for the next planes.
+class PlaneExtractor {
+public:
+  enum Axis { AXIAL, CORONAL, SAGITTAL };
+
+  /// Number of consecutive sagittal planes extracted at once
+  static const int SAGITTAL_SLAB_SIZE = 32;
+
+  PlaneExtractor();
+
+  /// Set the volume from which planes are extracted, clears the cache
+  void setVolume(std::shared_ptr<const RawData> volume);
+  /// Extract the planes from a paged volume instead, clears the cache
+  void setVolume(std::shared_ptr<const PagedVolume> volume);
+
+  /// Number of planes along the axis, 0 if no volume is set
+  int getNbPlanes(Axis axis) const;
+
+  /// Dimensions of the planes along the axis, in voxels:
+  /// - AXIAL: columns * rows
+  /// - CORONAL: columns * layers
+  /// - SAGITTAL: rows * layers
+  void getPlaneSize(Axis axis, int *plane_width, int *plane_height) const;
+
+  /// The modality values of the plane 'idx' stored line by line. The pointer
+  /// is valid until the next call or until the volume changes.
+  const int16_t *getPlane(Axis axis, int idx);
+
+private:
+  std::shared_ptr<const RawData> volume;
+  /// The volume used if it is too large for memory, volume is then null
+  std::shared_ptr<const PagedVolume> paged_volume;
+  /// Dimensions of the volume, 0 if none is set
+  int width;
+  int height;
+  int depth;
+  /// Storage of the last plane extracted from paged_volume
+  std::vector<int16_t> paged_plane;
+  /// Storage of the last coronal plane
+  std::vector<int16_t> coronal_plane;
+  /// The planes of the cached sagittal slab, one after the other
+  std::vector<int16_t> sagittal_slab;
+  /// The first plane of the cached sagittal slab, -1 if none
+  int sagittal_slab_first;
+
+  void updateSagittalSlab(int first_plane);
+};
+
+#endif // PLANE_EXTRACTOR_H
@@ -0,0 +1,174 @@
+#include "render_command.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+
+#include <dcmtk/dcmdata/dcrledrg.h>
+
+#include "dicom_collection.h"
+#include "glwidget.h"
+#include "software_renderer.h"
+#include "transfer_function.h"
+#include "volume_cache.h"
+
+int runRenderCommand(const QStringList &arguments) {
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Ray cast a Dicom collection on the CPU and save the view to an image");
+  parser.addHelpOption();
+  parser.addPositionalArgument("files", "The files of the collection",
+                               "files...");
+  QCommandLineOption render_option("render", "Render without display");
+  QCommandLineOption output_option({"o", "output"}, "Output image",
+                                   "path", "view.png");
+  QCommandLineOption width_option("width", "Image width [px]", "px", "800");
+  QCommandLineOption height_option("height", "Image height [px]", "px",
+                                   "800");
+  QCommandLineOption center_option(
+      "window-center", "Window center, middle of values by default", "value");
+  QCommandLineOption width_window_option(
+      "window-width", "Window width, range of values by default", "value");
+  QCommandLineOption alpha_option("alpha", "Opacity of the voxels", "alpha",
+                                  "0.05");
+  QCommandLineOption classes_option("classes", "Color voxels by class");
+  QCommandLineOption k_option("k", "Number of classes", "k", "1");
+  QCommandLineOption hide_empty_option("hide-empty-points",
+                                      "Hide voxels with a grey level of 0");
+  QCommandLineOption frustum_option("frustum", "Use a perspective projection");
+  QCommandLineOption rotate_x_option("rotate-x", "Rotation around x [deg]",
+                                     "deg", "0");
+  QCommandLineOption rotate_y_option("rotate-y", "Rotation around y [deg]",
+                                     "deg", "0");
+  QCommandLineOption layout_option(
+      "layout", "Layout of the sampled values: linear or bricked", "layout",
+      "linear");
+  QCommandLineOption no_cache_option(
+      "no-cache", "Decode the files even if their volume is cached");
+  QCommandLineOption compress_option(
+      "compress", "Keep the volume packed in memory, bricks are unpacked "
+                  "while rendering");
+  QCommandLineOption memory_budget_option(
+      "memory-budget",
+      "Larger volumes are paged to disk, half of the memory by default",
+      "MiB");
+  parser.addOptions({render_option, output_option, width_option, height_option,
+                     center_option, width_window_option, alpha_option,
+                     classes_option, k_option, hide_empty_option,
+                     frustum_option, rotate_x_option, rotate_y_option,
+                     layout_option, no_cache_option, compress_option,
+                     memory_budget_option});
+  parser.process(arguments);
+
+  std::vector<std::string> paths;
+  for (const QString &file : parser.positionalArguments()) {
+    paths.push_back(file.toStdString());
+  }
+  DcmRLEDecoderRegistration::registerCodecs();
+  DicomCollection collection;
+  collection.compress_volume = parser.isSet(compress_option);
+  if (parser.isSet(memory_budget_option))
+    collection.memory_budget =
+        (size_t)parser.value(memory_budget_option).toULongLong() << 20;
+  std::string error_title, error_msg;
+  VolumeCache cache(VolumeCache::getDefaultDirectory());
+  QElapsedTimer load_timer;
+  load_timer.start();
+  // Cached volumes are dense, compressed ones are decoded again
+  if (!parser.isSet(no_cache_option) && !collection.compress_volume &&
+      cache.load(paths, &collection)) {
+    std::cout << "Loaded " << paths.size() << " files from cache in "
+              << load_timer.elapsed() << " ms" << std::endl;
+  } else {
+    if (!collection.load(paths, &error_title, &error_msg)) {
+      std::cerr << error_title << ": " << error_msg << std::endl;
+      return 1;
+    }
+    std::cout << "Loaded " << paths.size() << " files in "
+              << load_timer.elapsed() << " ms" << std::endl;
+    // Paged volumes are not cached
+    if (collection.volume && !cache.save(collection))
+      std::cerr << "Failed to cache the volume" << std::endl;
+  }
+
+  double window_center = (collection.min_value + collection.max_value) / 2;
+  double window_width = collection.max_value - collection.min_value;
+  if (parser.isSet(center_option))
+    window_center = parser.value(center_option).toDouble();
+  if (parser.isSet(width_window_option))
+    window_width = parser.value(width_window_option).toDouble();
+  // The values of paged volumes are not all read, the decoded range is used
+  double min_value = collection.min_value;
+  double max_value = collection.max_value;
+  if (collection.volume) {
+    const RawData &volume = *collection.volume;
+    auto minmax = std::minmax_element(volume.begin(), volume.end());
+    min_value = *minmax.first;
+    max_value = *minmax.second;
+  }
+  TransferFunction tf;
+  tf.build(min_value, max_value, window_center, window_width,
+           parser.value(alpha_option).toFloat(),
+           parser.value(k_option).toInt(), parser.isSet(classes_option),
+           parser.isSet(hide_empty_option));
+
+  QString layout = parser.value(layout_option);
+  if (layout != "linear" && layout != "bricked") {
+    std::cerr << "Unknown layout: " << layout.toStdString() << std::endl;
+    return 1;
+  }
+  SoftwareRenderer renderer;
+  renderer.setLayout(layout == "bricked" ? SoftwareRenderer::BRICKED
+                                         : SoftwareRenderer::LINEAR);
+  if (collection.paged_volume) {
+    const PagedVolume &volume = *collection.paged_volume;
+    if (volume.getStorage() == PagedVolume::PACKED)
+      std::cout << "Packed volume: " << (volume.getPackedSize() >> 20)
+                << " MiB" << std::endl;
+    else
+      std::cout << "Paged volume, budget "
+                << (volume.getMemoryBudget() >> 20) << " MiB" << std::endl;
+    if (volume.hasWriteError())
+      std::cerr << "Failed to write bricks to disk, "
+                << (volume.getMemoryUsage() >> 20) << " MiB in memory"
+                << std::endl;
+    renderer.setVolume(
+        std::shared_ptr<const PagedVolume>(collection.paged_volume),
+        GLWidget::getVoxelSize(volume.width, volume.height, volume.depth,
+                               volume.pixel_width, volume.pixel_height,
+                               volume.slice_spacing));
+  } else {
+    const RawData &volume = *collection.volume;
+    renderer.setVolume(collection.volume,
+                       GLWidget::getVoxelSize(volume.width, volume.height,
+                                              volume.depth, volume.pixel_width,
+                                              volume.pixel_height,
+                                              volume.slice_spacing));
+  }
+  renderer.setTransferFunction(tf);
+
+  QSize size(parser.value(width_option).toInt(),
+             parser.value(height_option).toInt());
+  QMatrix4x4 transform;
+  transform.rotate(parser.value(rotate_x_option).toFloat(), 1, 0, 0);
+  transform.rotate(parser.value(rotate_y_option).toFloat(), 0, 1, 0);
+  GLWidget::ViewType view_type = parser.isSet(frustum_option)
+                                     ? GLWidget::ViewType::FRUSTUM
+                                     : GLWidget::ViewType::RAYMARCH;
+  QMatrix4x4 view_matrix = GLWidget::getViewMatrix(
+      view_type, transform, 0, size.width() / (double)size.height());
+
+  QElapsedTimer timer;
+  timer.start();
+  QImage img = renderer.render(view_matrix, size);
+  std::cout << "Rendered " << size.width() << "*" << size.height() << " in "
+            << timer.elapsed() << " ms" << std::endl;
+  QString output = parser.value(output_option);
+  if (!img.save(output)) {
+    std::cerr << "Failed to save file: " << output.toStdString() << std::endl;
+    return 1;
+  }
+  return 0;
+}
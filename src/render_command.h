@@ -0,0 +1,13 @@
+#ifndef RENDER_COMMAND_H
+#define RENDER_COMMAND_H
+
+#include <QStringList>
+
+/// Load a Dicom collection and save the ray cast volume to an image without
+/// any display, 'arguments' are the command-line arguments of the
+/// application. Return the exit code of the application.
+///
+/// Usage: dicom_viewer --render [options] files...
+int runRenderCommand(const QStringList &arguments);
+
+#endif // RENDER_COMMAND_H
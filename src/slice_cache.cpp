@@ -0,0 +1,190 @@
+#include "slice_cache.h"
+
+#include <algorithm>
+
+#include "thread_pool.h"
+#include "window_level.h"
+
+SliceCache::SliceCache(size_t capacity, int prefetch_distance)
+    : state(std::make_shared<State>()), prefetch_distance(prefetch_distance),
+      last_layer(-1), direction(1) {
+  state->window_center = 0;
+  state->window_width = 1;
+  state->generation = 0;
+  state->nb_building = 0;
+  state->capacity = std::max(capacity, (size_t)1);
+}
+
+void SliceCache::setVolume(std::shared_ptr<const RawData> volume) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->volume = std::move(volume);
+  state->paged_volume.reset();
+  state->invalidate();
+  last_layer = -1;
+  direction = 1;
+}
+
+void SliceCache::setVolume(std::shared_ptr<const PagedVolume> volume) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->volume.reset();
+  state->paged_volume = std::move(volume);
+  state->invalidate();
+  last_layer = -1;
+  direction = 1;
+}
+
+void SliceCache::setWindow(double window_center, double window_width) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (window_center == state->window_center &&
+      window_width == state->window_width)
+    return;
+  state->window_center = window_center;
+  state->window_width = window_width;
+  state->invalidate();
+}
+
+void SliceCache::cancelPrefetch() {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->invalidate();
+  state->idle_cond.wait(lock, [this]() { return state->nb_building == 0; });
+}
+
+QImage SliceCache::getImage(int layer) {
+  std::shared_ptr<const RawData> volume;
+  std::shared_ptr<const PagedVolume> paged_volume;
+  double window_center, window_width;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    volume = state->volume;
+    paged_volume = state->paged_volume;
+    if (layer < 0 || layer >= state->getDepth())
+      return QImage();
+    window_center = state->window_center;
+    window_width = state->window_width;
+  }
+  // Prefetching only when scrolling, window changes keep the same layer
+  if (layer != last_layer) {
+    if (last_layer >= 0)
+      direction = layer > last_layer ? 1 : -1;
+    last_layer = layer;
+    prefetch(layer);
+  }
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto it = state->entries.find(layer);
+    if (it != state->entries.end()) {
+      state->lru.splice(state->lru.begin(), state->lru, it->second.lru_pos);
+      return it->second.img;
+    }
+  }
+  // Building the missing image without holding the lock, a prefetch task
+  // might insert the same layer meanwhile
+  QImage img = buildImage(volume.get(), paged_volume.get(), layer,
+                          window_center, window_width);
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (state->volume == volume && state->paged_volume == paged_volume &&
+      state->window_center == window_center &&
+      state->window_width == window_width)
+    state->insert(layer, img);
+  return img;
+}
+
+size_t SliceCache::size() const {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->entries.size();
+}
+
+void SliceCache::prefetch(int layer) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  int depth = state->getDepth();
+  // Prefetched images must not evict the ones being displayed
+  int distance = std::min(prefetch_distance, (int)state->capacity / 2);
+  for (int i = 1; i <= distance; i++) {
+    int target = layer + i * direction;
+    if (target < 0 || target >= depth)
+      break;
+    if (state->entries.count(target) || state->pending.count(target))
+      continue;
+    state->pending.insert(target);
+    std::shared_ptr<State> shared_state = state;
+    std::shared_ptr<const RawData> volume = state->volume;
+    std::shared_ptr<const PagedVolume> paged_volume = state->paged_volume;
+    double window_center = state->window_center;
+    double window_width = state->window_width;
+    int generation = state->generation;
+    ThreadPool::getInstance().submit([=]() {
+      {
+        // Skipping the work if the cache was invalidated since
+        std::lock_guard<std::mutex> lock(shared_state->mutex);
+        if (shared_state->generation != generation)
+          return;
+        shared_state->nb_building++;
+      }
+      QImage img = buildImage(volume.get(), paged_volume.get(), target,
+                              window_center, window_width);
+      std::lock_guard<std::mutex> lock(shared_state->mutex);
+      if (--shared_state->nb_building == 0)
+        shared_state->idle_cond.notify_all();
+      if (shared_state->generation != generation)
+        return;
+      shared_state->pending.erase(target);
+      if (!shared_state->entries.count(target))
+        shared_state->insert(target, img);
+    });
+  }
+}
+
+QImage SliceCache::buildImage(const RawData *volume,
+                              const PagedVolume *paged_volume, int layer,
+                              double window_center, double window_width) {
+  int width = volume ? volume->width : paged_volume->width;
+  int height = volume ? volume->height : paged_volume->height;
+  QImage img(width, height, QImage::Format_Grayscale8);
+  // The layers of paged volumes are copied from their bricks
+  std::vector<int16_t> paged_layer;
+  const int16_t *values = nullptr;
+  if (volume) {
+    values = volume->getLayer(layer);
+  } else {
+    paged_layer.resize((size_t)width * height);
+    paged_volume->copyRegion(0, 0, layer, width, height, 1,
+                             paged_layer.data());
+    values = paged_layer.data();
+  }
+  // Lines of a QImage are 32-bit aligned, they are windowed one by one
+  for (int y = 0; y < height; y++) {
+    applyWindow(values + (size_t)y * width, width, window_center,
+                window_width, img.scanLine(y));
+  }
+  return img;
+}
+
+void SliceCache::State::insert(int layer, const QImage &img) {
+  auto it = entries.find(layer);
+  if (it != entries.end()) {
+    it->second.img = img;
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    return;
+  }
+  lru.push_front(layer);
+  entries[layer] = Entry{img, lru.begin()};
+  while (entries.size() > capacity) {
+    entries.erase(lru.back());
+    lru.pop_back();
+  }
+}
+
+int SliceCache::State::getDepth() const {
+  if (volume)
+    return volume->depth;
+  if (paged_volume)
+    return paged_volume->depth;
+  return 0;
+}
+
+void SliceCache::State::invalidate() {
+  generation++;
+  entries.clear();
+  lru.clear();
+  pending.clear();
+}
@@ -0,0 +1,106 @@
+#ifndef SLICE_CACHE_H
+#define SLICE_CACHE_H
+
+#include <QImage>
+
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#include "paged_volume.h"
+#include "raw_data.h"
+
+/// The windowed 8-bit images of the layers of a volume, bounded LRU cache
+///
+/// Scrolling through the layers only requires a lookup: the images of the
+/// layers following the requested one in the direction of the scroll are
+/// computed ahead of time by the ThreadPool. Methods are meant to be called
+/// from the GUI thread, the prefetch tasks only share the internal state so
+/// that they can outlive the cache.
+///
+/// Images of a PagedVolume are built from the bricks of their layer, the
+/// prefetch tasks load the bricks of the next layers in the background.
+class SliceCache {
+public:
+  /// Keep at most 'capacity' images, prefetch up to 'prefetch_distance'
+  /// layers ahead of the requested one
+  explicit SliceCache(size_t capacity = 64, int prefetch_distance = 8);
+
+  SliceCache(const SliceCache &other) = delete;
+  SliceCache &operator=(const SliceCache &other) = delete;
+
+  /// Set the volume from which images are built, clears the cache
+  void setVolume(std::shared_ptr<const RawData> volume);
+  /// Build the images from a paged volume instead, clears the cache
+  void setVolume(std::shared_ptr<const PagedVolume> volume);
+  /// Set the window applied to the images, clears the cache if it changed
+  void setWindow(double window_center, double window_width);
+  /// Clear the cache and wait for the prefetch tasks building images, e.g.
+  /// before the values of the volume are modified
+  void cancelPrefetch();
+
+  /// The image of 'layer', built on the calling thread if it is not cached
+  /// yet. Return a null image if 'layer' is not in the volume.
+  QImage getImage(int layer);
+
+  /// Number of images currently cached
+  size_t size() const;
+
+private:
+  /// The content shared with the prefetch tasks
+  struct State {
+    std::mutex mutex;
+    std::shared_ptr<const RawData> volume;
+    /// The volume used if it is too large for memory, volume is then null
+    std::shared_ptr<const PagedVolume> paged_volume;
+    double window_center;
+    double window_width;
+    /// Incremented each time the cached images become invalid, results of
+    /// prefetch tasks started before are discarded
+    int generation;
+    size_t capacity;
+    /// Layers from the most recently used to the least recently used
+    std::list<int> lru;
+    struct Entry {
+      QImage img;
+      std::list<int>::iterator lru_pos;
+    };
+    std::unordered_map<int, Entry> entries;
+    /// Layers being built by prefetch tasks
+    std::set<int> pending;
+    /// Number of prefetch tasks reading the volume, idle_cond is notified
+    /// when it drops to 0
+    int nb_building;
+    std::condition_variable idle_cond;
+
+    /// Insert or replace 'img' as the most recently used, evicting the least
+    /// recently used images if needed. The mutex has to be locked.
+    void insert(int layer, const QImage &img);
+    /// Clear the cache and invalidate pending tasks, mutex has to be locked
+    void invalidate();
+    /// Number of layers of the volume, 0 if none is set. The mutex has to
+    /// be locked.
+    int getDepth() const;
+  };
+
+  std::shared_ptr<State> state;
+  int prefetch_distance;
+  /// The last requested layer, -1 if none
+  int last_layer;
+  /// +1 or -1 depending on the direction of the scroll
+  int direction;
+
+  /// Queue the building of the layers following 'layer' in 'direction'
+  void prefetch(int layer);
+
+  /// Apply the window to 'layer' of 'volume' or, if it is null, of
+  /// 'paged_volume'
+  static QImage buildImage(const RawData *volume,
+                           const PagedVolume *paged_volume, int layer,
+                           double window_center, double window_width);
+};
+
+#endif // SLICE_CACHE_H
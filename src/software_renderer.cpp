@@ -0,0 +1,242 @@
+#include "software_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "thread_pool.h"
+#include "trilinear.h"
+
+/// Accumulated opacity above which the rays are terminated
+static const float opacity_threshold = 0.99;
+
+/// The values sampled by the rays of a tile: volumes in memory are sampled
+/// in place, paged volumes through a reader owned by the tile
+static const RawData &getTileValues(const RawData &values) { return values; }
+static const BrickedVolume<int16_t> &
+getTileValues(const BrickedVolume<int16_t> &values) {
+  return values;
+}
+static PagedVolume::Reader getTileValues(const PagedVolume &values) {
+  return PagedVolume::Reader(values);
+}
+
+SoftwareRenderer::SoftwareRenderer()
+    : layout(LINEAR), z_min(0), z_max(std::numeric_limits<int>::max()),
+      highlighted_layer(-1) {}
+
+void SoftwareRenderer::setVolume(std::shared_ptr<const RawData> new_volume,
+                                 const QVector3D &new_voxel_size) {
+  voxel_size = new_voxel_size;
+  if (new_volume == volume && !paged_volume)
+    return;
+  volume = std::move(new_volume);
+  paged_volume.reset();
+  if (volume)
+    bricks.build(*volume);
+  else
+    bricks = BrickTable();
+  updateEmptyBricks();
+  updateBrickedVolume();
+}
+
+void SoftwareRenderer::setVolume(
+    std::shared_ptr<const PagedVolume> new_volume,
+    const QVector3D &new_voxel_size) {
+  voxel_size = new_voxel_size;
+  if (new_volume == paged_volume && !volume)
+    return;
+  paged_volume = std::move(new_volume);
+  volume.reset();
+  if (paged_volume)
+    bricks.build(*paged_volume);
+  else
+    bricks = BrickTable();
+  updateEmptyBricks();
+  updateBrickedVolume();
+}
+
+void SoftwareRenderer::updateLayers(int first_layer, int last_layer) {
+  if (paged_volume) {
+    bricks.updateLayers(*paged_volume, first_layer, last_layer);
+    updateEmptyBricks();
+  }
+  if (!volume)
+    return;
+  bricks.updateLayers(*volume, first_layer, last_layer);
+  updateEmptyBricks();
+  if (!bricked_volume.empty())
+    bricked_volume.copyLayers(*volume, first_layer, last_layer);
+}
+
+void SoftwareRenderer::setLayout(Layout new_layout) {
+  if (new_layout == layout)
+    return;
+  layout = new_layout;
+  updateBrickedVolume();
+}
+
+void SoftwareRenderer::setTransferFunction(const TransferFunction &tf) {
+  transfer_function = tf;
+  updateEmptyBricks();
+}
+
+void SoftwareRenderer::setLayerRange(int new_z_min, int new_z_max) {
+  z_min = new_z_min;
+  z_max = new_z_max;
+}
+
+void SoftwareRenderer::setHighlightedLayer(int layer) {
+  highlighted_layer = layer;
+}
+
+void SoftwareRenderer::updateEmptyBricks() {
+  brick_empty.resize(bricks.size());
+  for (size_t i = 0; i < bricks.size(); i++) {
+    brick_empty[i] =
+        transfer_function.isTransparent(bricks.getMin(i), bricks.getMax(i));
+  }
+}
+
+void SoftwareRenderer::updateBrickedVolume() {
+  if (layout == BRICKED && volume)
+    bricked_volume = BrickedVolume<int16_t>(*volume);
+  else
+    bricked_volume = BrickedVolume<int16_t>();
+}
+
+template <typename V>
+float SoftwareRenderer::sample(const V &values, const QVector3D &p) {
+  const float coords[3] = {p.x(), p.y(), p.z()};
+  return sampleTrilinear(values, coords);
+}
+
+template <typename V>
+QVector4D SoftwareRenderer::castRay(const V &values, const QVector3D &origin,
+                                    const QVector3D &target) const {
+  const int dims[3] = {values.width, values.height, values.depth};
+  const int nb_bricks[3] = {bricks.getBricksX(), bricks.getBricksY(),
+                           bricks.getBricksZ()};
+  const int brick_size = BrickTable::BRICK_SIZE;
+  QVector3D dir = target - origin;
+  // Avoiding divisions by 0 for axis-aligned rays
+  for (int axis = 0; axis < 3; axis++) {
+    if (dir[axis] == 0)
+      dir[axis] = 1e-7;
+  }
+  // Voxels are centered on integer coordinates
+  QVector3D box_min(-0.5, -0.5, std::max(z_min, 0) - 0.5);
+  QVector3D box_max(dims[0] - 0.5, dims[1] - 0.5,
+                    std::min(z_max, dims[2] - 1) + 0.5);
+  float t_enter = 0;
+  float t_exit = 1;
+  for (int axis = 0; axis < 3; axis++) {
+    float t0 = (box_min[axis] - origin[axis]) / dir[axis];
+    float t1 = (box_max[axis] - origin[axis]) / dir[axis];
+    t_enter = std::max(t_enter, std::min(t0, t1));
+    t_exit = std::min(t_exit, std::max(t0, t1));
+  }
+  QVector4D acc(0, 0, 0, 0);
+  if (t_enter >= t_exit)
+    return acc;
+  // One sample per voxel crossed
+  float dt = 1 / dir.length();
+  int i = 0;
+  while (true) {
+    float t = t_enter + (i + 0.5f) * dt;
+    if (t > t_exit)
+      break;
+    QVector3D pos = origin + t * dir;
+    // Jumping to the exit of transparent bricks
+    int brick[3];
+    for (int axis = 0; axis < 3; axis++) {
+      float x = std::min(std::max(pos[axis], 0.0f), (float)(dims[axis] - 1));
+      brick[axis] = std::min((int)x / brick_size, nb_bricks[axis] - 1);
+    }
+    if (brick_empty[bricks.getIndex(brick[0], brick[1], brick[2])]) {
+      float t_brick = t_exit;
+      for (int axis = 0; axis < 3; axis++) {
+        // The first and last bricks extend beyond the volume
+        if (dir[axis] > 0 && brick[axis] < nb_bricks[axis] - 1) {
+          float limit = (brick[axis] + 1) * brick_size;
+          t_brick = std::min(t_brick, (limit - origin[axis]) / dir[axis]);
+        } else if (dir[axis] < 0 && brick[axis] > 0) {
+          float limit = brick[axis] * brick_size;
+          t_brick = std::min(t_brick, (limit - origin[axis]) / dir[axis]);
+        }
+      }
+      int next = (int)std::ceil((t_brick - t_enter) / dt - 0.5f);
+      i = std::max(i + 1, next);
+      continue;
+    }
+    QVector4D s = transfer_function.getColor(sample(values, pos));
+    if (s.w() > 0 && (int)std::floor(pos.z() + 0.5f) == highlighted_layer)
+      s.setW(1);
+    float weight = (1 - acc.w()) * s.w();
+    acc += QVector4D(weight * s.toVector3D(), weight);
+    // Early ray termination
+    if (acc.w() > opacity_threshold)
+      break;
+    i++;
+  }
+  return acc;
+}
+
+QImage SoftwareRenderer::render(const QMatrix4x4 &view_matrix,
+                                const QSize &size) const {
+  QImage img(size, QImage::Format_RGB32);
+  img.fill(Qt::black);
+  if (size.isEmpty() || brick_empty.empty())
+    return img;
+  if (paged_volume)
+    renderValues(*paged_volume, view_matrix, &img);
+  else if (!bricked_volume.empty())
+    renderValues(bricked_volume, view_matrix, &img);
+  else
+    renderValues(*volume, view_matrix, &img);
+  return img;
+}
+
+template <typename V>
+void SoftwareRenderer::renderValues(const V &values,
+                                    const QMatrix4x4 &view_matrix,
+                                    QImage *img) const {
+  QMatrix4x4 inv_view = view_matrix.inverted();
+  QVector3D half_dims(values.width / 2.0, values.height / 2.0,
+                      values.depth / 2.0);
+  int W = img->width();
+  int H = img->height();
+  int tiles_x = (W + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles_y = (H + TILE_SIZE - 1) / TILE_SIZE;
+  // Accessing the pixels once to avoid detaching from the workers
+  uchar *bits = img->bits();
+  int bytes_per_line = img->bytesPerLine();
+  ThreadPool::getInstance().parallelFor(0, tiles_x * tiles_y, [&](int tile) {
+    int x_begin = (tile % tiles_x) * TILE_SIZE;
+    int y_begin = (tile / tiles_x) * TILE_SIZE;
+    int x_end = std::min(x_begin + TILE_SIZE, W);
+    int y_end = std::min(y_begin + TILE_SIZE, H);
+    auto &&tile_values = getTileValues(values);
+    for (int y = y_begin; y < y_end; y++) {
+      QRgb *line = (QRgb *)(bits + (size_t)y * bytes_per_line);
+      float ndc_y = 1 - 2 * (y + 0.5f) / H;
+      for (int x = x_begin; x < x_end; x++) {
+        float ndc_x = 2 * (x + 0.5f) / W - 1;
+        // Ray from the near plane to the far plane in voxel coordinates
+        QVector3D near_pos =
+            (inv_view * QVector4D(ndc_x, ndc_y, -1, 1)).toVector3DAffine();
+        QVector3D far_pos =
+            (inv_view * QVector4D(ndc_x, ndc_y, 1, 1)).toVector3DAffine();
+        QVector4D color =
+            castRay(tile_values, near_pos / voxel_size + half_dims,
+                    far_pos / voxel_size + half_dims);
+        int rgb[3];
+        for (int channel = 0; channel < 3; channel++) {
+          float value = std::min(std::max(color[channel], 0.0f), 1.0f);
+          rgb[channel] = (int)std::round(255 * value);
+        }
+        line[x] = qRgb(rgb[0], rgb[1], rgb[2]);
+      }
+    }
+  });
+}
@@ -0,0 +1,105 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <memory>
+#include <vector>
+
+#include "brick_table.h"
+#include "bricked_volume.h"
+#include "paged_volume.h"
+#include "raw_data.h"
+#include "transfer_function.h"
+
+/// Ray casting of a volume on the CPU
+///
+/// The result matches the ray marching of GLWidget, it does not require an
+/// OpenGL context and can be used without display. The image is split in
+/// tiles rendered by the threads of the ThreadPool. Rays are terminated once
+/// almost opaque and skip the bricks of voxels that are fully transparent.
+///
+/// Volumes too large for memory are rendered from a PagedVolume, each tile
+/// only loads the bricks its rays sample.
+class SoftwareRenderer {
+public:
+  /// The layout of the values sampled by the rays
+  /// - LINEAR: the volume is sampled directly
+  /// - BRICKED: a copy of the volume stored in bricks is sampled, it uses
+  ///   more memory but the samples of a ray are closer in memory
+  enum Layout { LINEAR, BRICKED };
+
+  SoftwareRenderer();
+
+  /// Set the volume to render, 'voxel_size' is the size of a voxel in the
+  /// display space. The brick table is only recomputed if the volume
+  /// changed.
+  void setVolume(std::shared_ptr<const RawData> volume,
+                 const QVector3D &voxel_size);
+  /// Set a paged volume to render instead, the layout is ignored: its values
+  /// are already stored in bricks
+  void setVolume(std::shared_ptr<const PagedVolume> volume,
+                 const QVector3D &voxel_size);
+  /// The values of the layers [first_layer, last_layer] of the volume
+  /// changed, update their bricks
+  void updateLayers(int first_layer, int last_layer);
+  /// Change the layout of the sampled values, the bricked copy is built or
+  /// released accordingly
+  void setLayout(Layout layout);
+  /// Set the colors of the modality values, updates the skipped bricks
+  void setTransferFunction(const TransferFunction &tf);
+
+  /// Only the layers in [z_min, z_max] are rendered
+  void setLayerRange(int z_min, int z_max);
+  /// Visible samples of 'layer' are made opaque, -1 to disable
+  void setHighlightedLayer(int layer);
+
+  /// Render the volume seen through 'view_matrix' in an image of 'size'
+  QImage render(const QMatrix4x4 &view_matrix, const QSize &size) const;
+
+  /// Side of the square tiles of the image rendered by each task [px]
+  static const int TILE_SIZE = 32;
+
+private:
+  std::shared_ptr<const RawData> volume;
+  /// The volume rendered if it is too large for memory, volume is then null
+  std::shared_ptr<const PagedVolume> paged_volume;
+  Layout layout;
+  /// The values of volume in bricks, empty unless layout is BRICKED
+  BrickedVolume<int16_t> bricked_volume;
+  QVector3D voxel_size;
+  TransferFunction transfer_function;
+  int z_min;
+  int z_max;
+  int highlighted_layer;
+
+  /// Extremum modality values of the bricks of the volume
+  BrickTable bricks;
+  /// True for the bricks in which all samples are transparent
+  std::vector<bool> brick_empty;
+
+  void updateEmptyBricks();
+  /// Build bricked_volume from volume if the layout requires it
+  void updateBrickedVolume();
+
+  /// Trilinear interpolation of the modality values of 'values' at voxel
+  /// coordinates 'p', 'values' is either the volume, its bricked copy or a
+  /// reader of the paged volume
+  template <typename V>
+  static float sample(const V &values, const QVector3D &p);
+
+  /// Composite the samples of 'values' along the ray from 'origin' to
+  /// 'target' (voxel coordinates), return a premultiplied color
+  template <typename V>
+  QVector4D castRay(const V &values, const QVector3D &origin,
+                    const QVector3D &target) const;
+
+  /// Render 'values' seen through 'view_matrix' in 'img'
+  template <typename V>
+  void renderValues(const V &values, const QMatrix4x4 &view_matrix,
+                    QImage *img) const;
+};
+
+#endif // SOFTWARE_RENDERER_H
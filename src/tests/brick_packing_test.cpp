@@ -0,0 +1,95 @@
+#include "tests.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "brick_packing.h"
+
+namespace {
+/// Values of a brick of 32^3 values, as stored by PagedVolume
+const size_t brick_values = PACKED_LINE * PACKED_LINE * PACKED_LINE;
+
+/// Pack and unpack 'values', checking the values restored and, if not 0, the
+/// size of the packed values
+bool checkRoundTrip(const char *name, const std::vector<int16_t> &values,
+                    size_t expected_size) {
+  std::vector<uint8_t> packed;
+  packValues(values.data(), values.size(), &packed);
+  std::vector<int16_t> restored(values.size());
+  unpackValues(packed.data(), values.size(), restored.data());
+  bool ok = restored == values;
+  if (!ok)
+    std::printf("%s: values differ after the round trip\n", name);
+  if (expected_size != 0 && packed.size() != expected_size) {
+    std::printf("%s: %zu bytes packed instead of %zu\n", name, packed.size(),
+                expected_size);
+    ok = false;
+  }
+  std::printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+  return ok;
+}
+
+/// A brick whose first line is random and whose other lines differ from
+/// their reference line by values needing exactly 'bits' bits once zigzag
+/// encoded, the reference being the one used by packValues
+std::vector<int16_t> getLinesOfBits(int bits, std::mt19937 *generator) {
+  std::vector<uint16_t> values(brick_values);
+  std::uniform_int_distribution<int> any(0, 0xffff);
+  std::uniform_int_distribution<int> zigzags(0, (1 << bits) - 1);
+  size_t nb_lines = brick_values / PACKED_LINE;
+  for (size_t line = 0; line < nb_lines; line++) {
+    uint16_t *dst = values.data() + line * PACKED_LINE;
+    if (line == 0) {
+      for (size_t i = 0; i < PACKED_LINE; i++)
+        dst[i] = (uint16_t)any(*generator);
+      continue;
+    }
+    // The line above, or the first line of the previous slice of lines
+    const uint16_t *reference =
+        line % PACKED_LINE != 0 ? dst - PACKED_LINE
+                                : dst - PACKED_LINE * PACKED_LINE;
+    for (size_t i = 0; i < PACKED_LINE; i++) {
+      // The largest difference is used once per line
+      uint16_t zigzag = i == line % PACKED_LINE ? (uint16_t)((1 << bits) - 1)
+                                                : (uint16_t)zigzags(*generator);
+      uint16_t delta = (uint16_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+      dst[i] = (uint16_t)(reference[i] + delta);
+    }
+  }
+  return std::vector<int16_t>(values.begin(), values.end());
+}
+} // namespace
+
+bool testBrickPacking() {
+  bool ok = true;
+  std::mt19937 generator(1234);
+  size_t nb_lines = brick_values / PACKED_LINE;
+  // Mode, bits per line, the first line on 16 bits, the others on 'bits'
+  // bits, then 8 bytes of padding
+  for (int bits = 0; bits <= 16; bits++) {
+    size_t expected_size = 1 + nb_lines + PACKED_LINE * 16 / 8 +
+                           (nb_lines - 1) * PACKED_LINE * bits / 8 + 8;
+    std::string name = "lines of " + std::to_string(bits) + " bits";
+    ok &= checkRoundTrip(name.c_str(), getLinesOfBits(bits, &generator),
+                         expected_size);
+  }
+  for (int16_t value : {(int16_t)0, (int16_t)-1000, (int16_t)-32768,
+                        (int16_t)32767}) {
+    std::string name = "constant " + std::to_string(value);
+    ok &= checkRoundTrip(name.c_str(),
+                         std::vector<int16_t>(brick_values, value), 3);
+  }
+  std::uniform_int_distribution<int> any(-32768, 32767);
+  std::vector<int16_t> noise(brick_values);
+  for (int16_t &value : noise)
+    value = (int16_t)any(generator);
+  ok &= checkRoundTrip("full range noise", noise, 0);
+  // A single line, smaller than a slice of lines
+  std::vector<int16_t> line(PACKED_LINE);
+  for (size_t i = 0; i < PACKED_LINE; i++)
+    line[i] = (int16_t)(i * 37 - 500);
+  ok &= checkRoundTrip("single line", line, 0);
+  return ok;
+}
@@ -0,0 +1,9 @@
+#include "tests.h"
+
+int main() {
+  bool ok = true;
+  ok &= testWindowLevel();
+  ok &= testBrickPacking();
+  ok &= testObliqueReslice();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+/// Each test prints a line per case and returns false if one of them failed
+
+/// Parallel windowing against a single applyWindow call
+bool testWindowLevel();
+/// Round trip of packValues and unpackValues
+bool testBrickPacking();
+/// Kernel chosen by reslice against a scalar trilinear interpolation
+bool testObliqueReslice();
+
+#endif // TESTS_H
@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# Tests of the modules that do not depend on Qt, run with 'make check'
+#
+#-------------------------------------------------
+
+TARGET = tests
+TEMPLATE = app
+
+CONFIG += console testcase
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+        window_level_test.cpp \
+        brick_packing_test.cpp \
+        oblique_reslice_test.cpp \
+        ../thread_pool.cpp \
+        ../window_level.cpp \
+        ../brick_packing.cpp \
+        ../oblique_reslice.cpp
+
+HEADERS += \
+        tests.h \
+        ../thread_pool.h \
+        ../window_level.h \
+        ../brick_packing.h \
+        ../volume.h \
+        ../raw_data.h \
+        ../oblique_reslice.h
@@ -0,0 +1,98 @@
+#include "tests.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "window_level.h"
+
+namespace {
+/// Window a random volume with applyWindowToVolume and compare the grey
+/// levels and the classes, byte for byte, with a single applyWindow call
+bool testParallelWindow(double window_center, double window_width, int k) {
+  const size_t layer_size = 67 * 45;
+  const int nb_layers = 53;
+  const size_t count = layer_size * nb_layers;
+  int window_min, window_max;
+  getWindowBounds(window_center, window_width, &window_min, &window_max);
+
+  // Values around the window, with a share of values on its bounds
+  std::mt19937 generator(1234);
+  std::uniform_int_distribution<int> values(window_min - 200,
+                                            window_max + 200);
+  std::uniform_int_distribution<int> picks(0, 9);
+  std::vector<int16_t> src(count);
+  for (size_t i = 0; i < count; i++) {
+    int pick = picks(generator);
+    src[i] = (int16_t)(pick == 0   ? window_max
+                       : pick == 1 ? window_min
+                                   : values(generator));
+  }
+
+  std::vector<unsigned char> grey(count), classes(count);
+  std::vector<unsigned char> expected_grey(count), expected_classes(count);
+  applyWindow(src.data(), count, window_center, window_width,
+              expected_grey.data(), expected_classes.data(), k);
+  if (!applyWindowToVolume(src.data(), layer_size, nb_layers, window_center,
+                           window_width, grey.data(), classes.data(), k)) {
+    std::printf("applyWindowToVolume was cancelled\n");
+    return false;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < count && ok; i++) {
+    if (grey[i] != expected_grey[i] || classes[i] != expected_classes[i]) {
+      std::printf("value %d at %zu: grey %d instead of %d, class %d instead "
+                  "of %d\n",
+                  src[i], i, grey[i], expected_grey[i], classes[i],
+                  expected_classes[i]);
+      ok = false;
+    }
+  }
+  // The bounds and the outside of the window must have been exercised
+  size_t nb_max = 0, nb_outside = 0;
+  for (size_t i = 0; i < count && ok; i++) {
+    if (src[i] == window_max) {
+      nb_max++;
+      if (classes[i] != k) {
+        std::printf("class %d for window_max instead of %d\n", classes[i], k);
+        ok = false;
+      }
+    } else if (src[i] < window_min || src[i] > window_max) {
+      nb_outside++;
+      if (classes[i] != NO_CLASS) {
+        std::printf("class %d outside of the window instead of NO_CLASS\n",
+                    classes[i]);
+        ok = false;
+      }
+    }
+  }
+  if (ok && (nb_max == 0 || nb_outside == 0)) {
+    std::printf("window_max or NO_CLASS values not covered\n");
+    ok = false;
+  }
+
+  // Without classes, the grey levels must not change
+  std::vector<unsigned char> grey_only(count);
+  applyWindowToVolume(src.data(), layer_size, nb_layers, window_center,
+                      window_width, grey_only.data());
+  if (ok && std::memcmp(grey_only.data(), expected_grey.data(), count) != 0) {
+    std::printf("grey levels differ without classes\n");
+    ok = false;
+  }
+
+  std::printf("%s: center %g, width %g, k %d (%s)\n", ok ? "PASS" : "FAIL",
+              window_center, window_width, k, getWindowKernelName());
+  return ok;
+}
+} // namespace
+
+bool testWindowLevel() {
+  bool ok = true;
+  ok &= testParallelWindow(40, 400, 4);
+  ok &= testParallelWindow(-600, 1500, 7);
+  ok &= testParallelWindow(300.5, 2, 3);
+  ok &= testParallelWindow(100, 1, 1);
+  return ok;
+}
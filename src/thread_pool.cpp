@@ -0,0 +1,162 @@
+#include "thread_pool.h"
+
+#include <atomic>
+#include <exception>
+
+namespace {
+/// The pool and the index of the worker running on the current thread
+thread_local ThreadPool *current_pool = nullptr;
+thread_local int current_worker = -1;
+} // namespace
+
+ThreadPool::ThreadPool(int nb_threads)
+    : next_queue(0), nb_pending(0), stopping(false) {
+  if (nb_threads <= 0)
+    nb_threads = std::max(1, (int)std::thread::hardware_concurrency());
+  for (int i = 0; i < nb_threads; i++) {
+    queues.emplace_back(new WorkerQueue());
+  }
+  for (int i = 0; i < nb_threads; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+  int queue_idx;
+  if (current_pool == this)
+    queue_idx = current_worker;
+  else
+    queue_idx = next_queue++ % queues.size();
+  {
+    std::unique_lock<std::mutex> lock(queues[queue_idx]->mutex);
+    queues[queue_idx]->tasks.push_back(std::move(task));
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    nb_pending++;
+  }
+  cond.notify_one();
+}
+
+bool ThreadPool::pop(int worker_idx, std::function<void()> *task) {
+  // Most recent task of its own queue, it is the most likely to be in cache
+  {
+    WorkerQueue &queue = *queues[worker_idx];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+  // Oldest task of another queue
+  int nb_queues = queues.size();
+  for (int offset = 1; offset < nb_queues; offset++) {
+    WorkerQueue &queue = *queues[(worker_idx + offset) % nb_queues];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(int worker_idx) {
+  current_pool = this;
+  current_worker = worker_idx;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this]() { return stopping || nb_pending > 0; });
+      if (stopping && nb_pending == 0)
+        return;
+    }
+    std::function<void()> task;
+    // Another worker might have taken the task in the meantime
+    if (!pop(worker_idx, &task))
+      continue;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      nb_pending--;
+    }
+    task();
+  }
+}
+
+namespace {
+/// State shared by the threads working on the same parallelFor
+struct ParallelForState {
+  std::atomic<int> next;
+  int end;
+  int nb_done;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+
+/// Process indices of 'state' until there are none left
+void runParallelFor(ParallelForState *state,
+                    const std::function<void(int)> &f) {
+  int nb_processed = 0;
+  std::exception_ptr error;
+  int idx;
+  while ((idx = state->next++) < state->end) {
+    try {
+      if (!error)
+        f(idx);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    nb_processed++;
+  }
+  if (nb_processed == 0)
+    return;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->nb_done += nb_processed;
+  if (error && !state->error)
+    state->error = error;
+  state->cond.notify_all();
+}
+} // namespace
+
+void ThreadPool::parallelFor(int begin, int end,
+                             const std::function<void(int)> &f) {
+  if (end <= begin)
+    return;
+  auto state = std::make_shared<ParallelForState>();
+  state->next = begin;
+  state->end = end;
+  state->nb_done = 0;
+  // Helpers starting after all indices are taken leave immediately, so the
+  // caller only has to wait for the indices to be processed
+  int nb_helpers = std::min(size(), end - begin - 1);
+  for (int i = 0; i < nb_helpers; i++) {
+    push([state, f]() { runParallelFor(state.get(), f); });
+  }
+  runParallelFor(state.get(), f);
+  std::unique_lock<std::mutex> lock(state->mutex);
+  int nb_indices = end - begin;
+  state->cond.wait(lock, [&state, nb_indices]() {
+    return state->nb_done == nb_indices;
+  });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+ThreadPool &ThreadPool::getInstance() {
+  static ThreadPool instance;
+  return instance;
+}
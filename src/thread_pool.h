@@ -0,0 +1,78 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads with work stealing
+///
+/// Each worker owns a queue of tasks: tasks queued from a worker go to its
+/// own queue, other tasks are distributed among the queues. A worker runs
+/// the most recent task of its queue and, when it is empty, steals the
+/// oldest task of another queue.
+///
+/// Tasks must not interact with the widgets, results have to be merged back
+/// on the GUI thread.
+class ThreadPool {
+public:
+  /// Start 'nb_threads' workers, if 0 the number of cores is used
+  explicit ThreadPool(int nb_threads = 0);
+  /// Wait for the queued tasks to finish and join the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool &operator=(const ThreadPool &other) = delete;
+
+  int size() const { return (int)workers.size(); }
+
+  /// Queue 'task' and return a future on its result
+  template <typename F> auto submit(F &&task) -> std::future<decltype(task())> {
+    typedef decltype(task()) Result;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    push([packaged]() { (*packaged)(); });
+    return result;
+  }
+
+  /// Call 'f(idx)' for each idx in [begin, end) and wait for all the calls
+  /// to be done. The calling thread takes part to the work, so it is safe to
+  /// use from inside a task. The first exception thrown by 'f' is rethrown.
+  void parallelFor(int begin, int end, const std::function<void(int)> &f);
+
+  /// The pool shared by the whole application, sized to the number of cores
+  static ThreadPool &getInstance();
+
+private:
+  /// The tasks owned by a worker
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  /// Queue receiving the next task pushed from outside of the workers
+  std::atomic<unsigned> next_queue;
+  /// Number of tasks queued and not started yet
+  int nb_pending;
+  /// Protects nb_pending and stopping, used to put idle workers to sleep
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool stopping;
+
+  void push(std::function<void()> task);
+  /// Take a task from the queue of 'worker_idx' or steal one from another
+  /// queue, return false if all queues are empty
+  bool pop(int worker_idx, std::function<void()> *task);
+  void workerLoop(int worker_idx);
+};
+
+#endif // THREAD_POOL_H
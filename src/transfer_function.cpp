@@ -0,0 +1,85 @@
+#include "transfer_function.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "window_level.h"
+
+const QVector4D CLASS_PALETTE[] = {
+    QVector4D(1.0, 0.0, 0.0, 1.0), QVector4D(0.0, 1.0, 0.0, 1.0),
+    QVector4D(0.0, 0.0, 1.0, 1.0), QVector4D(1.0, 1.0, 0.0, 1.0),
+    QVector4D(1.0, 0.0, 1.0, 1.0), QVector4D(0.0, 1.0, 1.0, 1.0),
+    QVector4D(1.0, 1.0, 1.0, 1.0)};
+
+TransferFunction::TransferFunction() : min_value(0), max_value(1) {}
+
+void TransferFunction::build(double min, double max, double window_center,
+                             double window_width, float alpha, int k,
+                             bool use_classes, bool hide_empty_points,
+                             int size) {
+  min_value = min;
+  max_value = max > min ? max : min + 1;
+  std::vector<int16_t> values(size);
+  for (int i = 0; i < size; i++) {
+    double ratio = i / (double)(size - 1);
+    values[i] = std::round(min_value + ratio * (max_value - min_value));
+  }
+  std::vector<unsigned char> grey(size);
+  std::vector<unsigned char> classes(size);
+  applyWindow(values.data(), size, window_center, window_width, grey.data(),
+              classes.data(), k);
+  entries.resize(size);
+  nb_visible_before.resize(size + 1);
+  nb_visible_before[0] = 0;
+  for (int i = 0; i < size; i++) {
+    QVector4D color(grey[i] / 255.0, grey[i] / 255.0, grey[i] / 255.0, alpha);
+    if (use_classes) {
+      if (classes[i] == NO_CLASS)
+        color = QVector4D(0, 0, 0, 0);
+      else
+        color = QVector4D(CLASS_PALETTE[classes[i]].toVector3D(), alpha);
+    }
+    if (hide_empty_points && grey[i] == 0)
+      color.setW(0);
+    entries[i] = color;
+    nb_visible_before[i + 1] = nb_visible_before[i] + (color.w() > 0 ? 1 : 0);
+  }
+}
+
+float TransferFunction::getEntryPosition(float value) const {
+  // Entries are centered on their cell, as texels of a texture
+  float ratio = (value - min_value) / (max_value - min_value);
+  return ratio * entries.size() - 0.5f;
+}
+
+QVector4D TransferFunction::getColor(float value) const {
+  int last = (int)entries.size() - 1;
+  float pos = std::min(std::max(getEntryPosition(value), 0.0f), (float)last);
+  int idx = std::min((int)pos, last - 1);
+  if (idx < 0)
+    return entries.empty() ? QVector4D() : entries[0];
+  float frac = pos - idx;
+  return entries[idx] * (1 - frac) + entries[idx + 1] * frac;
+}
+
+bool TransferFunction::isTransparent(float min, float max) const {
+  if (entries.empty())
+    return true;
+  int last = (int)entries.size() - 1;
+  // Interpolation involves the entries surrounding the positions
+  int first_idx = (int)std::floor(getEntryPosition(min));
+  int last_idx = (int)std::ceil(getEntryPosition(max));
+  first_idx = std::min(std::max(first_idx, 0), last);
+  last_idx = std::min(std::max(last_idx, 0), last);
+  return nb_visible_before[last_idx + 1] == nb_visible_before[first_idx];
+}
+
+std::vector<unsigned char> TransferFunction::toRGBA8() const {
+  std::vector<unsigned char> rgba(4 * entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    for (int channel = 0; channel < 4; channel++) {
+      rgba[4 * i + channel] = std::round(255 * entries[i][channel]);
+    }
+  }
+  return rgba;
+}
@@ -0,0 +1,54 @@
+#ifndef TRANSFER_FUNCTION_H
+#define TRANSFER_FUNCTION_H
+
+#include <QVector4D>
+
+#include <vector>
+
+/// Colors of the classes when using 16-bit values
+extern const QVector4D CLASS_PALETTE[];
+const int CLASS_PALETTE_SIZE = 7;
+
+/// The color and opacity of modality values, sampled regularly over a range
+///
+/// Entries are windowed exactly as the points of the volume, so that ray
+/// marching on the GPU and on the CPU match the point display.
+class TransferFunction {
+public:
+  TransferFunction();
+
+  /// Sample 'size' entries over [min_value, max_value]
+  /// - use_classes: colors come from CLASS_PALETTE, values outside of the
+  ///   window are transparent
+  /// - hide_empty_points: values with a grey level of 0 are transparent
+  void build(double min_value, double max_value, double window_center,
+             double window_width, float alpha, int k, bool use_classes,
+             bool hide_empty_points, int size = 4096);
+
+  /// Linear interpolation of the entries at 'value', values outside of the
+  /// range use the closest entry
+  QVector4D getColor(float value) const;
+
+  /// True if all the values in [min, max] are fully transparent
+  bool isTransparent(float min, float max) const;
+
+  /// The entries as 8-bit RGBA, as expected by a 1D texture
+  std::vector<unsigned char> toRGBA8() const;
+
+  double getMin() const { return min_value; }
+  double getMax() const { return max_value; }
+  int size() const { return (int)entries.size(); }
+
+private:
+  double min_value;
+  double max_value;
+  std::vector<QVector4D> entries;
+  /// Number of visible entries before each index, used to check the
+  /// transparency of a range in constant time
+  std::vector<int> nb_visible_before;
+
+  /// Position of 'value' in the entries, not clamped
+  float getEntryPosition(float value) const;
+};
+
+#endif // TRANSFER_FUNCTION_H
@@ -0,0 +1,34 @@
+#ifndef TRILINEAR_H
+#define TRILINEAR_H
+
+#include <algorithm>
+
+/// Trilinear interpolation of the values of 'values' at voxel coordinates
+/// 'p', clamped to the volume. 'values' provides width, height, depth and
+/// getValue(x, y, z): a Volume, a BrickedVolume or a reader of a
+/// PagedVolume.
+template <typename V> float sampleTrilinear(const V &values, const float p[3]) {
+  const int dims[3] = {values.width, values.height, values.depth};
+  int i0[3], i1[3];
+  float f[3];
+  for (int axis = 0; axis < 3; axis++) {
+    float x = std::min(std::max(p[axis], 0.0f), (float)(dims[axis] - 1));
+    i0[axis] = (int)x;
+    i1[axis] = std::min(i0[axis] + 1, dims[axis] - 1);
+    f[axis] = x - i0[axis];
+  }
+  // Interpolating along x, then y, then z
+  auto lerp_x = [&](int y, int z) {
+    return values.getValue(i0[0], y, z) * (1 - f[0]) +
+           values.getValue(i1[0], y, z) * f[0];
+  };
+  float c00 = lerp_x(i0[1], i0[2]);
+  float c10 = lerp_x(i1[1], i0[2]);
+  float c01 = lerp_x(i0[1], i1[2]);
+  float c11 = lerp_x(i1[1], i1[2]);
+  float c0 = c00 * (1 - f[1]) + c10 * f[1];
+  float c1 = c01 * (1 - f[1]) + c11 * f[1];
+  return c0 * (1 - f[2]) + c1 * f[2];
+}
+
+#endif // TRILINEAR_H
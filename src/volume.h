@@ -0,0 +1,223 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/// An array of values whose first one is aligned on cache lines
+///
+/// The values are either allocated by the array or provided by the owner of
+/// an external buffer, such as a memory mapped file. Arrays can only be
+/// moved, the array moved from is left empty.
+template <typename T> class AlignedArray {
+public:
+  /// Alignment of the first value [bytes], also suitable for AVX loads
+  static const size_t ALIGNMENT = 64;
+
+  AlignedArray() : values(nullptr), nb_values(0) {}
+  AlignedArray(AlignedArray &&other)
+      : storage(std::move(other.storage)), release(std::move(other.release)),
+        values(other.values), nb_values(other.nb_values) {
+    other.release = nullptr;
+    other.values = nullptr;
+    other.nb_values = 0;
+  }
+  AlignedArray &operator=(AlignedArray &&other) {
+    if (&other == this)
+      return *this;
+    reset();
+    storage = std::move(other.storage);
+    release = std::move(other.release);
+    values = other.values;
+    nb_values = other.nb_values;
+    other.release = nullptr;
+    other.values = nullptr;
+    other.nb_values = 0;
+    return *this;
+  }
+  ~AlignedArray() { reset(); }
+
+  /// Allocate 'count' values, set to 0 if 'zero' is true, their content is
+  /// undefined otherwise. Previous values are released.
+  void allocate(size_t count, bool zero);
+  /// Use the 'count' values at 'external', which must be aligned as well.
+  /// 'external_release' is called once they are not used anymore. Previous
+  /// values are released.
+  void adopt(T *external, size_t count,
+             std::function<void()> external_release);
+  /// Release the values, the array is left empty
+  void reset();
+
+  T *data() { return values; }
+  const T *data() const { return values; }
+  size_t size() const { return nb_values; }
+
+private:
+  /// The allocation holding the values, 'values' is its first aligned
+  /// address. Empty for external values.
+  std::unique_ptr<unsigned char[]> storage;
+  /// Releases the external values, empty for allocated values
+  std::function<void()> release;
+  T *values;
+  size_t nb_values;
+};
+
+template <typename T> void AlignedArray<T>::reset() {
+  storage.reset();
+  if (release) {
+    release();
+    release = nullptr;
+  }
+  values = nullptr;
+  nb_values = 0;
+}
+
+template <typename T>
+void AlignedArray<T>::adopt(T *external, size_t count,
+                            std::function<void()> external_release) {
+  reset();
+  values = external;
+  nb_values = count;
+  release = std::move(external_release);
+}
+
+template <typename T> void AlignedArray<T>::allocate(size_t count, bool zero) {
+  reset();
+  if (count == 0)
+    return;
+  size_t bytes = count * sizeof(T) + ALIGNMENT - 1;
+  storage.reset(zero ? new unsigned char[bytes]() : new unsigned char[bytes]);
+  uintptr_t address = reinterpret_cast<uintptr_t>(storage.get());
+  address = (address + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+  values = reinterpret_cast<T *>(address);
+  nb_values = count;
+}
+
+/// A volume of values of type T with the geometry of its voxels
+///
+/// Values are stored column by column, line by line, then slice by slice in
+/// a single buffer aligned on cache lines, allocated by the volume or memory
+/// mapped. Indices are computed with size_t, volumes may hold more than 2^31
+/// voxels.
+///
+/// Volumes are shared through std::shared_ptr and never copied: they can
+/// only be moved.
+template <typename T> class Volume {
+public:
+  int width;
+  int height;
+  int depth;
+  /// The size of the voxels [mm]
+  double pixel_width;
+  double pixel_height;
+  double slice_spacing;
+  /// The window applied to the values, in modality values
+  double window_center;
+  double window_width;
+
+  /// An empty volume
+  Volume();
+  /// A volume of 'width' * 'height' * 'depth' values set to 0
+  Volume(int width, int height, int depth);
+  /// 'other' is left empty, its geometry is kept
+  Volume(Volume &&other) = default;
+  Volume &operator=(Volume &&other) = default;
+  Volume(const Volume &other) = delete;
+  Volume &operator=(const Volume &other) = delete;
+
+  /// Reallocate the values for a volume of 'width' * 'height' * 'depth',
+  /// their content is undefined. Voxel sizes and window are kept.
+  void resize(int width, int height, int depth);
+  /// Use the 'width' * 'height' * 'depth' values at 'external' instead of
+  /// allocating them, e.g. a memory mapped file. They must be aligned on
+  /// AlignedArray::ALIGNMENT and stay valid until 'release' is called.
+  void adopt(int width, int height, int depth, T *external,
+             std::function<void()> release);
+
+  T *data() { return values.data(); }
+  const T *data() const { return values.data(); }
+  const T *begin() const { return values.data(); }
+  const T *end() const { return values.data() + values.size(); }
+  /// Number of values stored
+  size_t size() const { return values.size(); }
+  bool empty() const { return values.size() == 0; }
+  /// Number of values in a layer
+  size_t getLayerSize() const { return (size_t)width * height; }
+
+  /// Position of the voxel in the values
+  size_t getIndex(int col, int row, int layer) const {
+    return ((size_t)layer * height + row) * width + col;
+  }
+  T getValue(int col, int row, int layer) const {
+    return data()[getIndex(col, row, layer)];
+  }
+
+  /// The 'width' * 'height' values of 'layer', no copy is involved
+  T *getLayer(int layer) { return data() + (size_t)layer * getLayerSize(); }
+  const T *getLayer(int layer) const {
+    return data() + (size_t)layer * getLayerSize();
+  }
+  /// The 'width' values of 'row' in 'layer', no copy is involved
+  T *getRow(int row, int layer) { return data() + getIndex(0, row, layer); }
+  const T *getRow(int row, int layer) const {
+    return data() + getIndex(0, row, layer);
+  }
+
+  /// Copy the 'width' * 'height' values of 'layer_data' to 'layer'
+  /// Throws std::out_of_range if 'layer' is not in the volume
+  void setLayer(const T *layer_data, int layer);
+  void setWindow(double window_center, double window_width);
+
+private:
+  AlignedArray<T> values;
+};
+
+template <typename T>
+Volume<T>::Volume()
+    : width(-1), height(-1), depth(-1), pixel_width(-1), pixel_height(-1),
+      slice_spacing(0), window_center(0), window_width(1) {}
+
+template <typename T>
+Volume<T>::Volume(int W, int H, int D)
+    : width(W), height(H), depth(D), pixel_width(-1), pixel_height(-1),
+      slice_spacing(0), window_center(0), window_width(1) {
+  values.allocate((size_t)W * H * D, true);
+}
+
+template <typename T> void Volume<T>::resize(int W, int H, int D) {
+  width = W;
+  height = H;
+  depth = D;
+  values.allocate((size_t)W * H * D, false);
+}
+
+template <typename T>
+void Volume<T>::adopt(int W, int H, int D, T *external,
+                      std::function<void()> release) {
+  width = W;
+  height = H;
+  depth = D;
+  values.adopt(external, (size_t)W * H * D, std::move(release));
+}
+
+template <typename T>
+void Volume<T>::setLayer(const T *layer_data, int layer) {
+  if (layer < 0 || layer >= depth)
+    throw std::out_of_range(
+        "Layer " + std::to_string(layer) +
+        " is outside of volume (depth=" + std::to_string(depth) + ")");
+  std::memcpy(getLayer(layer), layer_data, getLayerSize() * sizeof(T));
+}
+
+template <typename T>
+void Volume<T>::setWindow(double new_window_center, double new_window_width) {
+  window_center = new_window_center;
+  window_width = new_window_width;
+}
+
+#endif // VOLUME_H
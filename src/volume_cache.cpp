@@ -0,0 +1,229 @@
+#include "volume_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+/// Identifies the entries, the version changes with their layout
+const char entry_magic[8] = {'D', 'V', 'V', 'O', 'L', 'U', 'M', 'E'};
+const uint32_t entry_version = 1;
+/// The values start on a page boundary, so that they can be mapped
+const uint64_t values_alignment = 4096;
+
+/// The fixed part of an entry, followed by the patient name, the table of
+/// the files and, at 'values_offset', the values of the volume. Entries are
+/// local to a machine, fields use its byte order.
+struct EntryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nb_files;
+  uint64_t values_offset;
+  int32_t width;
+  int32_t height;
+  int32_t depth;
+  int32_t min_instance;
+  int32_t max_instance;
+  uint32_t patient_name_size;
+  double pixel_width;
+  double pixel_height;
+  double slice_spacing;
+  double min_value;
+  double max_value;
+  double window_center;
+  double window_width;
+};
+static_assert(sizeof(EntryHeader) == 104, "EntryHeader must not be padded");
+
+/// Append the raw bytes of 'value' to 'bytes'
+template <typename T> void appendRaw(QByteArray *bytes, const T &value) {
+  bytes->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/// Read the raw bytes of 'value' from 'file', return false if too short
+template <typename T> bool readRaw(QFile *file, T *value) {
+  return file->read(reinterpret_cast<char *>(value), sizeof(T)) ==
+         (qint64)sizeof(T);
+}
+} // namespace
+
+VolumeCache::VolumeCache(const std::string &directory)
+    : directory(directory) {}
+
+std::string VolumeCache::getDefaultDirectory() {
+  QString location =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  return QDir(location).filePath("volumes").toStdString();
+}
+
+std::string
+VolumeCache::getEntryPath(const std::vector<std::string> &paths) const {
+  // The order of the selection does not matter, nor the working directory
+  std::vector<QFileInfo> infos;
+  for (const std::string &path : paths) {
+    QFileInfo info(QString::fromStdString(path));
+    if (!info.exists())
+      return std::string();
+    infos.push_back(info);
+  }
+  std::sort(infos.begin(), infos.end(),
+            [](const QFileInfo &a, const QFileInfo &b) {
+              return a.absoluteFilePath() < b.absoluteFilePath();
+            });
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  for (const QFileInfo &info : infos) {
+    QByteArray key = info.absoluteFilePath().toUtf8();
+    key.append('\0');
+    key.append(QByteArray::number(info.size()));
+    key.append('\0');
+    key.append(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    key.append('\n');
+    hash.addData(key);
+  }
+  QString name = QString::fromLatin1(hash.result().toHex()) + ".vol";
+  return QDir(QString::fromStdString(directory)).filePath(name).toStdString();
+}
+
+bool VolumeCache::load(const std::vector<std::string> &paths,
+                       DicomCollection *collection) const {
+  std::string entry_path = getEntryPath(paths);
+  if (entry_path.empty())
+    return false;
+  // The file stays open as long as the volume is mapped
+  std::shared_ptr<QFile> file =
+      std::make_shared<QFile>(QString::fromStdString(entry_path));
+  if (!file->open(QIODevice::ReadOnly))
+    return false;
+  EntryHeader header;
+  if (!readRaw(file.get(), &header) ||
+      std::memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0 ||
+      header.version != entry_version || header.nb_files != paths.size() ||
+      header.width <= 0 || header.height <= 0 || header.depth <= 0)
+    return false;
+  size_t nb_values = (size_t)header.width * header.height * header.depth;
+  uint64_t values_size = nb_values * sizeof(int16_t);
+  if ((uint64_t)file->size() != header.values_offset + values_size)
+    return false;
+  QByteArray patient_name = file->read(header.patient_name_size);
+  if ((uint32_t)patient_name.size() != header.patient_name_size)
+    return false;
+  std::map<int, std::string> file_paths;
+  for (uint32_t i = 0; i < header.nb_files; i++) {
+    int32_t instance;
+    uint32_t path_size;
+    if (!readRaw(file.get(), &instance) || !readRaw(file.get(), &path_size))
+      return false;
+    QByteArray path = file->read(path_size);
+    if ((uint32_t)path.size() != path_size)
+      return false;
+    file_paths[instance] = path.toStdString();
+  }
+  // Private mapping: pages are read on first access and never written back
+  uchar *values = file->map(header.values_offset, values_size,
+                            QFileDevice::MapPrivateOption);
+  if (values == nullptr)
+    return false;
+  std::shared_ptr<RawData> volume = std::make_shared<RawData>();
+  volume->adopt(header.width, header.height, header.depth, (int16_t *)values,
+                [file, values]() { file->unmap(values); });
+  volume->pixel_width = header.pixel_width;
+  volume->pixel_height = header.pixel_height;
+  volume->slice_spacing = header.slice_spacing;
+
+  collection->files.clear();
+  collection->file_paths = std::move(file_paths);
+  collection->volume = std::move(volume);
+  collection->patient_name = patient_name.toStdString();
+  collection->min_value = header.min_value;
+  collection->max_value = header.max_value;
+  collection->width = header.width;
+  collection->height = header.height;
+  collection->window_center = header.window_center;
+  collection->window_width = header.window_width;
+  collection->pixel_width = header.pixel_width;
+  collection->pixel_height = header.pixel_height;
+  collection->slice_spacing = header.slice_spacing;
+  collection->min_instance = header.min_instance;
+  collection->max_instance = header.max_instance;
+  // prune removes the entries modified the longest time ago, loading an
+  // entry makes it the most recently used. Failing to do so is harmless.
+  file->setFileTime(QDateTime::currentDateTime(),
+                    QFileDevice::FileModificationTime);
+  return true;
+}
+
+bool VolumeCache::save(const DicomCollection &collection) const {
+  const RawData *volume = collection.volume.get();
+  if (volume == nullptr || volume->empty() || collection.file_paths.empty())
+    return false;
+  std::vector<std::string> paths;
+  QByteArray files_table;
+  for (const auto &entry : collection.file_paths) {
+    paths.push_back(entry.second);
+    appendRaw(&files_table, (int32_t)entry.first);
+    appendRaw(&files_table, (uint32_t)entry.second.size());
+    files_table.append(entry.second.data(), (int)entry.second.size());
+  }
+  std::string entry_path = getEntryPath(paths);
+  if (entry_path.empty() || !QDir().mkpath(QString::fromStdString(directory)))
+    return false;
+
+  QByteArray patient_name = QByteArray::fromStdString(collection.patient_name);
+  EntryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+  header.version = entry_version;
+  header.nb_files = (uint32_t)collection.file_paths.size();
+  header.width = volume->width;
+  header.height = volume->height;
+  header.depth = volume->depth;
+  header.min_instance = collection.min_instance;
+  header.max_instance = collection.max_instance;
+  header.patient_name_size = (uint32_t)patient_name.size();
+  header.pixel_width = volume->pixel_width;
+  header.pixel_height = volume->pixel_height;
+  header.slice_spacing = volume->slice_spacing;
+  header.min_value = collection.min_value;
+  header.max_value = collection.max_value;
+  header.window_center = collection.window_center;
+  header.window_width = collection.window_width;
+  uint64_t table_end =
+      sizeof(header) + patient_name.size() + files_table.size();
+  header.values_offset = (table_end + values_alignment - 1) /
+                         values_alignment * values_alignment;
+
+  // Written next to the entry and renamed on commit
+  QSaveFile file(QString::fromStdString(entry_path));
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(patient_name);
+  file.write(files_table);
+  file.write(QByteArray((int)(header.values_offset - table_end), '\0'));
+  file.write(reinterpret_cast<const char *>(volume->data()),
+             (qint64)(volume->size() * sizeof(int16_t)));
+  // Failed writes are reported by commit, the entry is then discarded
+  if (!file.commit())
+    return false;
+  prune();
+  return true;
+}
+
+void VolumeCache::prune() const {
+  QDir dir(QString::fromStdString(directory));
+  QFileInfoList entries =
+      dir.entryInfoList(QStringList("*.vol"), QDir::Files, QDir::Time);
+  // Entries are sorted from the most recent one
+  for (int i = MAX_ENTRIES; i < entries.size(); i++) {
+    QFile::remove(entries[i].absoluteFilePath());
+  }
+}
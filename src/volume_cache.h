@@ -0,0 +1,52 @@
+#ifndef VOLUME_CACHE_H
+#define VOLUME_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "dicom_collection.h"
+
+/// The decoded volumes of collections stored on disk, so that collections
+/// can be opened again without reading their files
+///
+/// An entry holds a header describing the collection, the path of each of
+/// its files and the raw 16-bit values of its volume. Entries are named after
+/// a hash of the paths, sizes and modification times of the files: any
+/// change to the files leads to a new entry. Loaded volumes are memory
+/// mapped, their pages are only read from disk when accessed. The least
+/// recently used entries, saved or loaded, are removed when MAX_ENTRIES is
+/// exceeded.
+class VolumeCache {
+public:
+  /// Maximal number of entries kept in the directory
+  static const int MAX_ENTRIES = 8;
+
+  /// Entries are stored in 'directory', created when needed
+  explicit VolumeCache(const std::string &directory);
+
+  /// The directory used by default, in the cache location of the user
+  static std::string getDefaultDirectory();
+
+  /// Fill 'collection' with the cached entry of the files at 'paths', return
+  /// false if there is none. The files are not parsed: 'files' stays empty
+  /// and 'file_paths' is filled from the entry.
+  bool load(const std::vector<std::string> &paths,
+            DicomCollection *collection) const;
+
+  /// Store 'collection' once its volume is fully decoded, return false on
+  /// failure. The entry is written to a temporary file and renamed, loads
+  /// never see a partial entry. Can be run from a worker thread.
+  bool save(const DicomCollection &collection) const;
+
+  /// The path of the entry of the files at 'paths', empty if one of the
+  /// files can't be accessed
+  std::string getEntryPath(const std::vector<std::string> &paths) const;
+
+private:
+  std::string directory;
+
+  /// Remove the least recently used entries beyond MAX_ENTRIES
+  void prune() const;
+};
+
+#endif // VOLUME_CACHE_H
@@ -0,0 +1,250 @@
+#include "window_level.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "thread_pool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WINDOW_LEVEL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+/// The window parameters in the form used by the kernels, all the kernels
+/// apply exactly the same single precision operations
+struct KernelParams {
+  /// Grey level is (value - lower) * scale + 0.5 clamped to [0, 255]
+  float lower;
+  float scale;
+  /// Class is (value - class_min) * class_scale clamped to [0, k - 1]
+  float class_min;
+  float class_max;
+  float class_scale;
+  int k;
+};
+
+typedef void (*WindowKernel)(const int16_t *src, size_t count,
+                             const KernelParams &params, unsigned char *grey,
+                             unsigned char *classes);
+
+void windowScalar(const int16_t *src, size_t count, const KernelParams &params,
+                  unsigned char *grey, unsigned char *classes) {
+  for (size_t i = 0; i < count; i++) {
+    float value = src[i];
+    float g = (value - params.lower) * params.scale + 0.5f;
+    grey[i] = (unsigned char)std::min(std::max(g, 0.0f), 255.0f);
+    if (!classes)
+      continue;
+    if (value < params.class_min || value > params.class_max) {
+      classes[i] = NO_CLASS;
+    } else if (value == params.class_max) {
+      classes[i] = params.k;
+    } else {
+      float c = (value - params.class_min) * params.class_scale;
+      classes[i] = (unsigned char)std::min(std::max(c, 0.0f),
+                                           (float)(params.k - 1));
+    }
+  }
+}
+
+#ifdef WINDOW_LEVEL_X86
+/// Grey levels and classes of 4 values as 32-bit integers
+__attribute__((target("sse2"))) inline void
+windowSSE2Block(__m128 value, const KernelParams &params, __m128i *grey,
+                __m128i *classes) {
+  __m128 g = _mm_add_ps(
+      _mm_mul_ps(_mm_sub_ps(value, _mm_set1_ps(params.lower)),
+                 _mm_set1_ps(params.scale)),
+      _mm_set1_ps(0.5f));
+  g = _mm_min_ps(_mm_max_ps(g, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+  *grey = _mm_cvttps_epi32(g);
+  __m128 c = _mm_mul_ps(_mm_sub_ps(value, _mm_set1_ps(params.class_min)),
+                        _mm_set1_ps(params.class_scale));
+  c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()),
+                 _mm_set1_ps((float)(params.k - 1)));
+  __m128i cls = _mm_cvttps_epi32(c);
+  __m128i on_max =
+      _mm_castps_si128(_mm_cmpeq_ps(value, _mm_set1_ps(params.class_max)));
+  __m128i outside = _mm_castps_si128(
+      _mm_or_ps(_mm_cmplt_ps(value, _mm_set1_ps(params.class_min)),
+                _mm_cmpgt_ps(value, _mm_set1_ps(params.class_max))));
+  cls = _mm_or_si128(_mm_andnot_si128(on_max, cls),
+                     _mm_and_si128(on_max, _mm_set1_epi32(params.k)));
+  cls = _mm_or_si128(_mm_andnot_si128(outside, cls),
+                     _mm_and_si128(outside, _mm_set1_epi32(NO_CLASS)));
+  *classes = cls;
+}
+
+__attribute__((target("sse2"))) void
+windowSSE2(const int16_t *src, size_t count, const KernelParams &params,
+           unsigned char *grey, unsigned char *classes) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i values = _mm_loadu_si128((const __m128i *)(src + i));
+    // Sign extension of the 16-bit values to 32-bit
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+    __m128i grey_lo, grey_hi, classes_lo, classes_hi;
+    windowSSE2Block(_mm_cvtepi32_ps(lo), params, &grey_lo, &classes_lo);
+    windowSSE2Block(_mm_cvtepi32_ps(hi), params, &grey_hi, &classes_hi);
+    __m128i grey16 = _mm_packs_epi32(grey_lo, grey_hi);
+    _mm_storel_epi64((__m128i *)(grey + i), _mm_packus_epi16(grey16, grey16));
+    if (classes) {
+      __m128i classes16 = _mm_packs_epi32(classes_lo, classes_hi);
+      _mm_storel_epi64((__m128i *)(classes + i),
+                       _mm_packus_epi16(classes16, classes16));
+    }
+  }
+  windowScalar(src + i, count - i, params, grey + i,
+               classes ? classes + i : nullptr);
+}
+
+/// Grey levels and classes of 8 values as 32-bit integers
+__attribute__((target("avx2"))) inline void
+windowAVX2Block(__m256 value, const KernelParams &params, __m256i *grey,
+                __m256i *classes) {
+  __m256 g = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_sub_ps(value, _mm256_set1_ps(params.lower)),
+                    _mm256_set1_ps(params.scale)),
+      _mm256_set1_ps(0.5f));
+  g = _mm256_min_ps(_mm256_max_ps(g, _mm256_setzero_ps()),
+                    _mm256_set1_ps(255.0f));
+  *grey = _mm256_cvttps_epi32(g);
+  __m256 c =
+      _mm256_mul_ps(_mm256_sub_ps(value, _mm256_set1_ps(params.class_min)),
+                    _mm256_set1_ps(params.class_scale));
+  c = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()),
+                    _mm256_set1_ps((float)(params.k - 1)));
+  __m256i cls = _mm256_cvttps_epi32(c);
+  __m256i on_max = _mm256_castps_si256(_mm256_cmp_ps(
+      value, _mm256_set1_ps(params.class_max), _CMP_EQ_OQ));
+  __m256i outside = _mm256_castps_si256(_mm256_or_ps(
+      _mm256_cmp_ps(value, _mm256_set1_ps(params.class_min), _CMP_LT_OQ),
+      _mm256_cmp_ps(value, _mm256_set1_ps(params.class_max), _CMP_GT_OQ)));
+  cls = _mm256_blendv_epi8(cls, _mm256_set1_epi32(params.k), on_max);
+  cls = _mm256_blendv_epi8(cls, _mm256_set1_epi32(NO_CLASS), outside);
+  *classes = cls;
+}
+
+/// Pack 2*8 integers in [0, 255] to 16 bytes, keeping their order
+__attribute__((target("avx2"))) inline __m128i packAVX2(__m256i a,
+                                                         __m256i b) {
+  __m128i a16 = _mm_packs_epi32(_mm256_castsi256_si128(a),
+                                _mm256_extracti128_si256(a, 1));
+  __m128i b16 = _mm_packs_epi32(_mm256_castsi256_si128(b),
+                                _mm256_extracti128_si256(b, 1));
+  return _mm_packus_epi16(a16, b16);
+}
+
+__attribute__((target("avx2"))) void
+windowAVX2(const int16_t *src, size_t count, const KernelParams &params,
+           unsigned char *grey, unsigned char *classes) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i lo = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *)(src + i)));
+    __m256i hi = _mm256_cvtepi16_epi32(
+        _mm_loadu_si128((const __m128i *)(src + i + 8)));
+    __m256i grey_lo, grey_hi, classes_lo, classes_hi;
+    windowAVX2Block(_mm256_cvtepi32_ps(lo), params, &grey_lo, &classes_lo);
+    windowAVX2Block(_mm256_cvtepi32_ps(hi), params, &grey_hi, &classes_hi);
+    _mm_storeu_si128((__m128i *)(grey + i), packAVX2(grey_lo, grey_hi));
+    if (classes)
+      _mm_storeu_si128((__m128i *)(classes + i),
+                       packAVX2(classes_lo, classes_hi));
+  }
+  windowSSE2(src + i, count - i, params, grey + i,
+             classes ? classes + i : nullptr);
+}
+#endif
+
+struct KernelChoice {
+  WindowKernel kernel;
+  const char *name;
+};
+
+KernelChoice chooseKernel() {
+#ifdef WINDOW_LEVEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {windowAVX2, "AVX2"};
+  if (__builtin_cpu_supports("sse2"))
+    return {windowSSE2, "SSE2"};
+#endif
+  return {windowScalar, "scalar"};
+}
+
+KernelChoice &getKernel() {
+  static KernelChoice choice = chooseKernel();
+  return choice;
+}
+} // namespace
+
+void getWindowBounds(double window_center, double window_width,
+                     int *window_min, int *window_max) {
+  *window_min = std::round(window_center - window_width / 2);
+  *window_max = std::round(window_center + window_width / 2);
+}
+
+void applyWindow(const int16_t *src, size_t count, double window_center,
+                 double window_width, unsigned char *grey,
+                 unsigned char *classes, int k) {
+  KernelParams params;
+  // Values below 'lower' are black, values above the upper bound
+  // 'lower + window_width - 1' are white
+  params.lower = window_center - 0.5 - (window_width - 1) / 2;
+  params.scale = window_width > 1 ? 255.0 / (window_width - 1) : 1e30f;
+  int window_min, window_max;
+  getWindowBounds(window_center, window_width, &window_min, &window_max);
+  params.class_min = window_min;
+  params.class_max = window_max;
+  params.class_scale =
+      window_max > window_min ? k / (double)(window_max - window_min) : 0;
+  params.k = std::max(k, 1);
+  getKernel().kernel(src, count, params, grey, classes);
+}
+
+bool applyWindowToVolume(const int16_t *src, size_t layer_size, int nb_layers,
+                         double window_center, double window_width,
+                         unsigned char *grey, unsigned char *classes, int k,
+                         const std::atomic<bool> *cancelled) {
+  ThreadPool &pool = ThreadPool::getInstance();
+  // A few slabs per thread to balance the load without too much overhead
+  int slab_layers = std::max(1, nb_layers / (4 * pool.size()));
+  int nb_slabs = (nb_layers + slab_layers - 1) / slab_layers;
+  pool.parallelFor(0, nb_slabs, [&](int slab) {
+    if (cancelled && cancelled->load())
+      return;
+    int first_layer = slab * slab_layers;
+    int slab_end = std::min(nb_layers, first_layer + slab_layers);
+    size_t offset = first_layer * layer_size;
+    applyWindow(src + offset, (slab_end - first_layer) * layer_size,
+                window_center, window_width, grey + offset,
+                classes ? classes + offset : nullptr, k);
+  });
+  return !(cancelled && cancelled->load());
+}
+
+const char *getWindowKernelName() { return getKernel().name; }
+
+bool setWindowKernel(const char *name) {
+  std::string kernel_name(name);
+  if (kernel_name == "scalar") {
+    getKernel() = {windowScalar, "scalar"};
+    return true;
+  }
+#ifdef WINDOW_LEVEL_X86
+  __builtin_cpu_init();
+  if (kernel_name == "SSE2" && __builtin_cpu_supports("sse2")) {
+    getKernel() = {windowSSE2, "SSE2"};
+    return true;
+  }
+  if (kernel_name == "AVX2" && __builtin_cpu_supports("avx2")) {
+    getKernel() = {windowAVX2, "AVX2"};
+    return true;
+  }
+#endif
+  return false;
+}
@@ -0,0 +1,52 @@
+#ifndef WINDOW_LEVEL_H
+#define WINDOW_LEVEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Class stored for modality values outside of the window
+const unsigned char NO_CLASS = 255;
+
+/// Compute the bounds of the window in modality values, the classes split
+/// [window_min, window_max] in k parts of equal size
+void getWindowBounds(double window_center, double window_width,
+                     int *window_min, int *window_max);
+
+/// Convert modality values (e.g. HU for CT) to 8-bit grey levels using the
+/// linear VOI function of the DICOM standard (PS3.3 C.11.2.1.2), which is the
+/// one applied by DicomImage::setWindow
+///
+/// If 'classes' is not null, it is filled in the same pass with:
+/// - floor(k * (value - window_min) / (window_max - window_min)) inside the
+///   window
+/// - k for value == window_max
+/// - NO_CLASS outside of the window
+///
+/// The fastest implementation supported by the CPU (AVX2, SSE2 or scalar) is
+/// chosen on first call.
+void applyWindow(const int16_t *src, size_t count, double window_center,
+                 double window_width, unsigned char *grey,
+                 unsigned char *classes = nullptr, int k = 1);
+
+/// Apply applyWindow on a volume of 'nb_layers' layers of 'layer_size'
+/// values. Slabs of consecutive layers are processed in parallel on the
+/// ThreadPool, each value being computed exactly as applyWindow would.
+///
+/// If 'cancelled' is set while running, the remaining slabs are skipped and
+/// false is returned, the output is then partially written.
+bool applyWindowToVolume(const int16_t *src, size_t layer_size, int nb_layers,
+                         double window_center, double window_width,
+                         unsigned char *grey, unsigned char *classes = nullptr,
+                         int k = 1,
+                         const std::atomic<bool> *cancelled = nullptr);
+
+/// Name of the implementation used by applyWindow, for diagnostic purpose
+const char *getWindowKernelName();
+
+/// Force the implementation used by applyWindow: "AVX2", "SSE2" or "scalar",
+/// e.g. to compare them. Returns false if the CPU does not support it.
+/// Must not be called while windowing.
+bool setWindowKernel(const char *name);
+
+#endif // WINDOW_LEVEL_H